@@ -0,0 +1,480 @@
+/*!\file analytics.c
+ *
+ * \brief Measures of a generated labyrinth.
+ *
+ * The labyrinth is split in bands of rows, taken by threads from a
+ * shared counter ; the calling thread takes bands too. The local
+ * measures (branching, dead ends, corridors) only need the neighbour
+ * rows of each cell.
+ *
+ * The solution length and the diameter are exact since a perfect
+ * labyrinth is a tree. Each band builds the spanning tree of its cells
+ * reachable from its terminals (the cells joined to the neighbour
+ * bands, start and exit) and keeps its virtual tree : the terminals
+ * and the cells where paths between terminals branch, joined by
+ * weighted edges that summarize the paths between them and the
+ * subtrees hanging from those paths. The other cells of the band only
+ * matter through the diameter of their band component. The virtual
+ * trees of all bands, joined across band borders, are then walked once
+ * from start. Every pass reads a band of rows, not the whole
+ * labyrinth.
+ */
+#include "analytics.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WALL ((unsigned int)-1)
+/*!\brief cells of a band (at least one row) */
+#define BAND_CELLS (1 << 20)
+/*!\brief parent of a cell not reached yet */
+#define UNSEEN -2
+/* flags of a band cell : a terminal is in its subtree, one or two of
+ * its children have a terminal in their subtree */
+#define TERMINAL 1
+#define HAS_TERMINAL 2
+#define ONE_CHILD 4
+#define TWO_CHILDREN 8
+#define VIRTUAL (TERMINAL | TWO_CHILDREN)
+
+/*!\brief node of a virtual tree */
+typedef struct vnode_t vnode_t;
+struct vnode_t {
+        /*!\brief height of its subtrees without a terminal */
+        int hang;
+        /*!\brief diameter of its band component if it is the root of it, 0
+         * otherwise */
+        int diam;
+};
+
+/*!\brief edge of a virtual tree from node a to its parent b : the
+ * length of the path and the farthest cell reachable from each end in
+ * the subtrees hanging from the inner cells of the path */
+typedef struct vedge_t vedge_t;
+struct vedge_t {
+        unsigned int a, b;
+        int len, reachA, reachB;
+};
+
+typedef struct band_t band_t;
+struct band_t {
+        int j0, j1;
+        unsigned long long degree[5], nodeDegrees;
+        vnode_t *node;
+        vedge_t *edge;
+        /*!\brief virtual nodes joined to the previous and next bands, by
+         * column */
+        unsigned int *top, *bot;
+        size_t nnode, nedge, ntop, nbot;
+        /*!\brief virtual node of start and exit, -1 if not in the band */
+        long long start, exit;
+        /*!\brief set once the band is measured */
+        int done;
+};
+
+typedef struct pass_t pass_t;
+struct pass_t {
+        const unsigned int *lab;
+        int w, h, rows, nbands;
+        /*!\brief start (-1 if it is a wall) and exit cells */
+        long long start, exit;
+        band_t *band;
+        /*!\brief next band to take */
+        int next;
+};
+
+/*!\brief per-thread arrays of the band trees, in local cell indices */
+typedef struct scratch_t scratch_t;
+struct scratch_t {
+        int *parent, *down, *hang, *vid, *ord;
+        /*!\brief terminals, and the first ord index and diameter of each
+         * band component */
+        int *term, *seg, *segDiam;
+        unsigned char *flags;
+};
+
+/*!\brief arc of the joined virtual trees, reachFrom and reachTo are
+ * measured from its source and its destination */
+typedef struct arc_t arc_t;
+struct arc_t {
+        unsigned int to;
+        int len, reachFrom, reachTo;
+};
+
+static int degree(const unsigned int *lab, int w, int h, int i, int j) {
+        return (i > 0 && lab[j * (size_t)w + i - 1] != WALL) +
+               (i < w - 1 && lab[j * (size_t)w + i + 1] != WALL) +
+               (j > 0 && lab[(j - 1) * (size_t)w + i] != WALL) +
+               (j < h - 1 && lab[(j + 1) * (size_t)w + i] != WALL);
+}
+
+static void bandDegrees(const pass_t *ps, band_t *bd) {
+        int i, j, d;
+        for (j = bd->j0; j < bd->j1; ++j)
+                for (i = 0; i < ps->w; ++i) {
+                        if (ps->lab[j * (size_t)ps->w + i] == WALL)
+                                continue;
+                        d = degree(ps->lab, ps->w, ps->h, i, j);
+                        ++bd->degree[d];
+                        if (d != 2)
+                                bd->nodeDegrees += d;
+                }
+}
+
+/*!\brief local index of \a c in band \a bd if it is a floor cell of
+ * it, -1 otherwise */
+static int localCell(const pass_t *ps, const band_t *bd, long long c) {
+        long long c0 = (long long)bd->j0 * ps->w, c1 = (long long)bd->j1 * ps->w;
+        return c >= c0 && c < c1 && ps->lab[c] != WALL ? (int)(c - c0) : -1;
+}
+
+/*!\brief builds the virtual tree of band \a bd.
+ * \return 0 on success, -1 if out of memory. */
+static int bandTree(const pass_t *ps, band_t *bd, scratch_t *s) {
+        const unsigned int *lab = ps->lab + (size_t)bd->j0 * ps->w;
+        int w = ps->w, n = (bd->j1 - bd->j0) * w, nt = 0, nroot = 0, tail = 0;
+        int ntop, nbot, ls = localCell(ps, bd, ps->start), le = localCell(ps, bd, ps->exit);
+        int head, nb[4], x, y, p, i, k, r, d, len, reach, m;
+        vedge_t *e;
+        for (x = 0; x < n; ++x) {
+                s->parent[x] = UNSEEN;
+                s->down[x] = s->hang[x] = 0;
+                s->flags[x] = 0;
+        }
+        if (bd->j0 > 0)
+                for (i = 0; i < w; ++i)
+                        if (lab[i] != WALL && lab[i - w] != WALL)
+                                s->term[nt++] = i;
+        ntop = nt;
+        if (bd->j1 < ps->h)
+                for (i = n - w; i < n; ++i)
+                        if (lab[i] != WALL && lab[i + w] != WALL)
+                                s->term[nt++] = i;
+        nbot = nt - ntop;
+        if (ls >= 0)
+                s->term[nt++] = ls;
+        if (le >= 0)
+                s->term[nt++] = le;
+        for (k = 0; k < nt; ++k)
+                s->flags[s->term[k]] = TERMINAL | HAS_TERMINAL;
+        /* one breadth-first tree per component holding a terminal, the
+         * others can't be reached from start */
+        for (k = 0; k < nt; ++k) {
+                if (s->parent[s->term[k]] != UNSEEN)
+                        continue;
+                s->seg[nroot++] = tail;
+                s->parent[s->term[k]] = -1;
+                s->ord[tail++] = s->term[k];
+                for (head = s->seg[nroot - 1]; head < tail; ++head) {
+                        x = s->ord[head];
+                        i = x % w;
+                        nb[0] = i > 0 ? x - 1 : -1;
+                        nb[1] = i < w - 1 ? x + 1 : -1;
+                        nb[2] = x >= w ? x - w : -1;
+                        nb[3] = x < n - w ? x + w : -1;
+                        for (d = 0; d < 4; ++d)
+                                if (nb[d] >= 0 && lab[nb[d]] != WALL &&
+                                    s->parent[nb[d]] == UNSEEN) {
+                                        s->parent[nb[d]] = x;
+                                        s->ord[tail++] = nb[d];
+                                }
+                }
+        }
+        s->seg[nroot] = tail;
+        /* heights, children toward terminals and diameters, children first */
+        for (r = 0; r < nroot; ++r) {
+                s->segDiam[r] = 0;
+                for (k = s->seg[r + 1] - 1; k >= s->seg[r]; --k) {
+                        x = s->ord[k];
+                        if ((p = s->parent[x]) < 0)
+                                continue;
+                        if (s->down[p] + s->down[x] + 1 > s->segDiam[r])
+                                s->segDiam[r] = s->down[p] + s->down[x] + 1;
+                        if (s->down[x] + 1 > s->down[p])
+                                s->down[p] = s->down[x] + 1;
+                        if (s->flags[x] & HAS_TERMINAL)
+                                s->flags[p] |= HAS_TERMINAL |
+                                               (s->flags[p] & ONE_CHILD ? TWO_CHILDREN : ONE_CHILD);
+                        else if (s->down[x] + 1 > s->hang[p])
+                                s->hang[p] = s->down[x] + 1;
+                }
+        }
+        bd->nnode = 0;
+        for (k = 0; k < tail; ++k)
+                if (s->flags[s->ord[k]] & VIRTUAL)
+                        s->vid[s->ord[k]] = bd->nnode++;
+        bd->nedge = bd->nnode - nroot;
+        bd->ntop = ntop;
+        bd->nbot = nbot;
+        bd->node = malloc((bd->nnode + 1) * sizeof *bd->node);
+        bd->edge = malloc((bd->nedge + 1) * sizeof *bd->edge);
+        bd->top = malloc((ntop + 1) * sizeof *bd->top);
+        bd->bot = malloc((nbot + 1) * sizeof *bd->bot);
+        if (!bd->node || !bd->edge || !bd->top || !bd->bot)
+                return -1;
+        for (k = 0, e = bd->edge; k < tail; ++k) {
+                x = s->ord[k];
+                if (!(s->flags[x] & VIRTUAL))
+                        continue;
+                bd->node[s->vid[x]].hang = s->hang[x];
+                bd->node[s->vid[x]].diam = 0;
+                if (s->parent[x] < 0)
+                        continue;
+                /* up to the nearest virtual ancestor ; the inner cells
+                 * have one child toward terminals, the others hang */
+                reach = 0;
+                m = -n;
+                for (y = s->parent[x], len = 1; !(s->flags[y] & VIRTUAL); y = s->parent[y], ++len) {
+                        if (len + s->hang[y] > reach)
+                                reach = len + s->hang[y];
+                        if (s->hang[y] - len > m)
+                                m = s->hang[y] - len;
+                }
+                e->a = s->vid[x];
+                e->b = s->vid[y];
+                e->len = len;
+                e->reachA = reach;
+                e->reachB = len > 1 ? len + m : 0;
+                ++e;
+        }
+        for (r = 0; r < nroot; ++r)
+                bd->node[s->vid[s->ord[s->seg[r]]]].diam = s->segDiam[r];
+        for (k = 0; k < ntop; ++k)
+                bd->top[k] = s->vid[s->term[k]];
+        for (k = 0; k < nbot; ++k)
+                bd->bot[k] = s->vid[s->term[ntop + k]];
+        bd->start = ls >= 0 ? s->vid[ls] : -1;
+        bd->exit = le >= 0 ? s->vid[le] : -1;
+        return 0;
+}
+
+static void scratchFree(scratch_t *s) {
+        free(s->parent);
+        free(s->down);
+        free(s->hang);
+        free(s->vid);
+        free(s->ord);
+        free(s->term);
+        free(s->seg);
+        free(s->segDiam);
+        free(s->flags);
+}
+
+/*!\brief measures bands until none is left */
+static void *bandThread(void *arg) {
+        pass_t *ps = arg;
+        size_t n = (size_t)ps->rows * ps->w, nt = 2 * (size_t)ps->w + 2;
+        scratch_t s;
+        int b;
+        s.parent = malloc(n * sizeof *s.parent);
+        s.down = malloc(n * sizeof *s.down);
+        s.hang = malloc(n * sizeof *s.hang);
+        s.vid = malloc(n * sizeof *s.vid);
+        s.ord = malloc(n * sizeof *s.ord);
+        s.term = malloc(nt * sizeof *s.term);
+        s.seg = malloc((nt + 1) * sizeof *s.seg);
+        s.segDiam = malloc(nt * sizeof *s.segDiam);
+        s.flags = malloc(n);
+        /* the bands are left to the other threads */
+        if (!s.parent || !s.down || !s.hang || !s.vid || !s.ord || !s.term || !s.seg ||
+            !s.segDiam || !s.flags) {
+                scratchFree(&s);
+                return NULL;
+        }
+        while ((b = __atomic_fetch_add(&ps->next, 1, __ATOMIC_RELAXED)) < ps->nbands) {
+                bandDegrees(ps, &ps->band[b]);
+                ps->band[b].done = ps->start < 0 || bandTree(ps, &ps->band[b], &s) == 0;
+        }
+        scratchFree(&s);
+        return NULL;
+}
+
+/*!\brief joins the virtual trees of the bands and walks them from
+ * start, sets the solution length and the diameter of \a st.
+ * \return 0 on success, -1 if out of memory. */
+static int treeStats(const pass_t *ps, mazestats_t *st) {
+        size_t *base = malloc((ps->nbands + 1) * sizeof *base), *off = NULL, *pos = NULL;
+        size_t nn, nv, na = 0, k, x, p, root, exit = (size_t)-1;
+        vnode_t *node = NULL;
+        arc_t *arc = NULL, *a;
+        unsigned int *ord = NULL;
+        long long *par = NULL, *dist = NULL, *down = NULL, c;
+        const band_t *bd;
+        int b, ret = -1;
+        if (!base)
+                return -1;
+        for (b = 0, base[0] = 0; b < ps->nbands; ++b) {
+                bd = &ps->band[b];
+                base[b + 1] = base[b] + bd->nnode;
+                na += 2 * (bd->nedge + (b ? bd->ntop : 0));
+        }
+        nn = base[ps->nbands];
+        node = malloc((nn + 1) * sizeof *node);
+        off = calloc(nn + 1, sizeof *off);
+        pos = malloc((nn + 1) * sizeof *pos);
+        arc = malloc((na + 1) * sizeof *arc);
+        ord = malloc((nn + 1) * sizeof *ord);
+        par = malloc((nn + 1) * sizeof *par);
+        dist = malloc((nn + 1) * sizeof *dist);
+        down = malloc((nn + 1) * sizeof *down);
+        if (!node || !off || !pos || !arc || !ord || !par || !dist || !down)
+                goto end;
+        /* adjacency lists, the edges of the bands then the rows across borders */
+        for (b = 0; b < ps->nbands; ++b) {
+                bd = &ps->band[b];
+                memcpy(node + base[b], bd->node, bd->nnode * sizeof *node);
+                for (k = 0; k < bd->nedge; ++k) {
+                        ++off[base[b] + bd->edge[k].a + 1];
+                        ++off[base[b] + bd->edge[k].b + 1];
+                }
+                for (k = 0; b && k < bd->ntop; ++k) {
+                        ++off[base[b] + bd->top[k] + 1];
+                        ++off[base[b - 1] + ps->band[b - 1].bot[k] + 1];
+                }
+        }
+        for (x = 0; x < nn; ++x)
+                off[x + 1] += off[x];
+        memcpy(pos, off, nn * sizeof *pos);
+        for (b = 0; b < ps->nbands; ++b) {
+                bd = &ps->band[b];
+                for (k = 0; k < bd->nedge; ++k) {
+                        x = base[b] + bd->edge[k].a;
+                        p = base[b] + bd->edge[k].b;
+                        arc[pos[x]++] = (arc_t){p, bd->edge[k].len, bd->edge[k].reachA,
+                                                bd->edge[k].reachB};
+                        arc[pos[p]++] = (arc_t){x, bd->edge[k].len, bd->edge[k].reachB,
+                                                bd->edge[k].reachA};
+                }
+                for (k = 0; b && k < bd->ntop; ++k) {
+                        x = base[b] + bd->top[k];
+                        p = base[b - 1] + ps->band[b - 1].bot[k];
+                        arc[pos[x]++] = (arc_t){p, 1, 0, 0};
+                        arc[pos[p]++] = (arc_t){x, 1, 0, 0};
+                }
+        }
+        b = ps->start / ps->w / ps->rows;
+        root = base[b] + ps->band[b].start;
+        for (b = 0; b < ps->nbands; ++b)
+                if (ps->band[b].exit >= 0)
+                        exit = base[b] + ps->band[b].exit;
+        /* breadth-first from start ; par holds the arc from the parent and
+         * pos the parent */
+        for (x = 0; x < nn; ++x)
+                par[x] = UNSEEN;
+        par[root] = -1;
+        dist[root] = 0;
+        ord[0] = root;
+        for (k = 0, nv = 1; k < nv; ++k) {
+                x = ord[k];
+                down[x] = node[x].hang;
+                for (a = arc + off[x]; a < arc + off[x + 1]; ++a)
+                        if (par[a->to] == UNSEEN) {
+                                par[a->to] = a - arc;
+                                dist[a->to] = dist[x] + a->len;
+                                pos[a->to] = x;
+                                ord[nv++] = a->to;
+                        }
+        }
+        st->solution = exit != (size_t)-1 && par[exit] != UNSEEN ? dist[exit] : -1;
+        /* heights and diameter, children first */
+        st->diameter = 0;
+        for (k = nv; k-- > 0;) {
+                x = ord[k];
+                if (node[x].diam > st->diameter)
+                        st->diameter = node[x].diam;
+                if (par[x] < 0)
+                        continue;
+                a = &arc[par[x]];
+                p = pos[x];
+                if (down[x] + a->reachTo > st->diameter)
+                        st->diameter = down[x] + a->reachTo;
+                c = a->len + down[x] > a->reachFrom ? a->len + down[x] : a->reachFrom;
+                if (down[p] + c > st->diameter)
+                        st->diameter = down[p] + c;
+                if (c > down[p])
+                        down[p] = c;
+        }
+        ret = 0;
+end:
+        free(base);
+        free(node);
+        free(off);
+        free(pos);
+        free(arc);
+        free(ord);
+        free(par);
+        free(dist);
+        free(down);
+        return ret;
+}
+
+/*!\brief measures labyrinth \a lab of \a w x \a h cells (walls are -1,
+ * row-major) using \a nthreads threads. \a start and \a exit are cell
+ * indices used for the solution length.
+ * \return 0 on success, -1 otherwise. */
+int mazeStats(const unsigned int *lab, int w, int h, long long start, long long exit,
+              int nthreads, mazestats_t *st) {
+        pthread_t *th;
+        pass_t ps;
+        int b, t, started, d, ret = -1;
+        unsigned long long edges = 0;
+        memset(st, 0, sizeof *st);
+        st->diameter = st->solution = -1;
+        if (nthreads < 1)
+                nthreads = 1;
+        ps.lab = lab;
+        ps.w = w;
+        ps.h = h;
+        ps.rows = BAND_CELLS / w > 1 ? BAND_CELLS / w : 1;
+        if (ps.rows > h)
+                ps.rows = h;
+        ps.nbands = (h + ps.rows - 1) / ps.rows;
+        ps.start = start >= 0 && start < (long long)w * h && lab[start] != WALL ? start : -1;
+        ps.exit = exit;
+        ps.next = 0;
+        ps.band = calloc(ps.nbands, sizeof *ps.band);
+        th = malloc(nthreads * sizeof *th);
+        if (!ps.band || !th)
+                goto end;
+        for (b = 0; b < ps.nbands; ++b) {
+                ps.band[b].j0 = b * ps.rows;
+                ps.band[b].j1 = b < ps.nbands - 1 ? (b + 1) * ps.rows : h;
+        }
+        /* the calling thread measures too, alone if no thread starts */
+        for (t = 0; t < nthreads - 1; ++t)
+                if (pthread_create(&th[t], NULL, bandThread, &ps))
+                        break;
+        started = t;
+        bandThread(&ps);
+        for (t = 0; t < started; ++t)
+                pthread_join(th[t], NULL);
+        for (b = 0; b < ps.nbands; ++b) {
+                if (!ps.band[b].done)
+                        goto end;
+                for (d = 0; d < 5; ++d)
+                        st->degree[d] += ps.band[b].degree[d];
+                st->corridors += ps.band[b].nodeDegrees;
+        }
+        for (d = 0; d < 5; ++d) {
+                st->cells += st->degree[d];
+                edges += d * st->degree[d];
+        }
+        edges /= 2;
+        st->corridors /= 2;
+        st->deadEnds = st->degree[1];
+        st->junctions = st->degree[3] + st->degree[4];
+        st->avgCorridor = st->corridors ? edges / (double)st->corridors : 0.0;
+        if (ps.start >= 0 && treeStats(&ps, st) < 0)
+                goto end;
+        ret = 0;
+end:
+        for (b = 0; ps.band && b < ps.nbands; ++b) {
+                free(ps.band[b].node);
+                free(ps.band[b].edge);
+                free(ps.band[b].top);
+                free(ps.band[b].bot);
+        }
+        free(ps.band);
+        free(th);
+        return ret;
+}
@@ -0,0 +1,27 @@
+/*!\file analytics.h
+ *
+ * \brief Measures of a generated labyrinth (dead ends, branching,
+ * corridors, diameter and solution length).
+ */
+#ifndef ANALYTICS_H
+#define ANALYTICS_H
+
+/*!\brief measures of a labyrinth ; lengths are in cells (steps
+ * between 4-neighbour floor cells). */
+typedef struct mazestats_t mazestats_t;
+struct mazestats_t {
+        unsigned long long cells;
+        /*!\brief branching histogram : floor cells by number of floor neighbours */
+        unsigned long long degree[5];
+        unsigned long long deadEnds, junctions;
+        /*!\brief corridors join two cells that are not simple passages */
+        unsigned long long corridors;
+        double avgCorridor;
+        /*!\brief longest shortest path, -1 if exit is not reachable from start */
+        long long diameter, solution;
+};
+
+int mazeStats(const unsigned int *lab, int w, int h, long long start, long long exit,
+              int nthreads, mazestats_t *st);
+
+#endif
@@ -0,0 +1,67 @@
+/*!\file bakePVS.c
+ *
+ * \brief Offline tool baking the potentially visible sets of the
+ * labyrinth generated from a seed.
+ *
+ * Only the first level comes from such a file (window.c --pvs) : the
+ * sets of the next levels are baked at runtime by the level worker
+ * thread (level.c), not by this tool.
+ *
+ * usage : bakePVS seed [side [file]]
+ */
+#include "pvs.h"
+#include "memtrack.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/*!\brief must match _planeScale in window.c : the labyrinth spans
+ * 2 * PLANE_SCALE and the far plane is at PLANE_SCALE + 1 */
+#define PLANE_SCALE 100.0
+
+/* from makeLabyrinth.c */
+extern unsigned int *labyrinth(int w, int h);
+
+int main(int argc, char **argv) {
+        pvs_t pvs;
+        unsigned int seed, side = 15, *lab;
+        char name[64];
+        const char *filename = name;
+        int nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+        unsigned int radius;
+        unsigned long bytes;
+        time_t t0;
+        if (argc < 2) {
+                fprintf(stderr, "usage : %s seed [side [file]]\n", argv[0]);
+                return 1;
+        }
+        seed = strtoul(argv[1], NULL, 10);
+        if (argc > 2)
+                side = strtoul(argv[2], NULL, 10);
+        if (argc > 3)
+                filename = argv[3];
+        else
+                sprintf(name, "maze_%u_%u.pvs", seed, side);
+        /* farthest visible cell : far plane distance over cell size */
+        radius = pvsRadius(side, PLANE_SCALE);
+        /* same generation as initLevel() in window.c */
+        srand(seed);
+        lab = labyrinth(side, side);
+        t0 = time(NULL);
+        if (pvsBake(&pvs, lab, side, radius, nthreads) < 0) {
+                fprintf(stderr, "not enough memory to bake %u x %u\n", side, side);
+                return 1;
+        }
+        pvs.seed = seed;
+        if (pvsSave(&pvs, filename) < 0)
+                return 1;
+        bytes = (pvs.side * pvs.side + 1 + 2 * pvs.offsets[side * side]) * sizeof(unsigned int);
+        printf("%s : %u x %u cells, radius %u, %u runs (%lu bytes in memory), %d threads, "
+               "%ld s\n",
+               filename, side, side, radius, pvs.offsets[side * side], bytes, nthreads,
+               (long)(time(NULL) - t0));
+        pvsFree(&pvs);
+        memFree(lab);
+        return 0;
+}
@@ -0,0 +1,140 @@
+/*!\file checkPVS.c
+ *
+ * \brief Tool checking that the baked potentially visible sets hold
+ * every cell a brute-force ray casting sees, for a range of seeds.
+ *
+ * From every floor cell, rays leave random points of the cell in
+ * random directions and mark the cells they cross until the first
+ * wall (included). A marked cell missing from the cell set is an
+ * error : the sets must be conservative. Exits with 1 on any error.
+ *
+ * usage : checkPVS side firstSeed [lastSeed [raysPerCell]]
+ */
+#include "pvs.h"
+#include "memtrack.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/*!\brief must match _planeScale in window.c (see bakePVS.c) */
+#define PLANE_SCALE 100.0
+#define WALL ((unsigned int)-1)
+
+/* from makeLabyrinth.c */
+extern unsigned int *labyrinth(int w, int h);
+
+/*!\brief xorshift64 : the tool does not touch the rand() sequence of
+ * the generation */
+static double uniform(unsigned long long *s) {
+        *s ^= *s << 13;
+        *s ^= *s >> 7;
+        *s ^= *s << 17;
+        return (*s >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/*!\brief marks in \a seen the cells crossed by the ray leaving (x, y)
+ * (in cell units) along (dx, dy), up to the first wall, as long as
+ * they are in the baking window of cell (si, sj) : at most \a radius
+ * cells away on each axis and \a radius + 1 in distance. */
+static void castRay(const unsigned int *lab, int side, int radius, unsigned char *seen,
+                    int si, int sj, double x, double y, double dx, double dy) {
+        int i = (int)x, j = (int)y;
+        int sx = dx > 0 ? 1 : -1, sy = dy > 0 ? 1 : -1;
+        double tdx = dx != 0 ? 1.0 / fabs(dx) : HUGE_VAL;
+        double tdy = dy != 0 ? 1.0 / fabs(dy) : HUGE_VAL;
+        double tx = dx != 0 ? (sx > 0 ? i + 1 - x : x - i) * tdx : HUGE_VAL;
+        double ty = dy != 0 ? (sy > 0 ? j + 1 - y : y - j) * tdy : HUGE_VAL;
+        for (;;) {
+                if (i < 0 || j < 0 || i >= side || j >= side || abs(i - si) > radius ||
+                    abs(j - sj) > radius ||
+                    (i - si) * (i - si) + (j - sj) * (j - sj) > (radius + 1) * (radius + 1))
+                        return;
+                seen[j * side + i] = 1;
+                if (lab[j * side + i] == WALL)
+                        return;
+                if (tx < ty) {
+                        tx += tdx;
+                        i += sx;
+                } else {
+                        ty += tdy;
+                        j += sy;
+                }
+        }
+}
+
+int main(int argc, char **argv) {
+        pvs_t pvs;
+        unsigned int seed, first, last, *lab, nruns, k, c, radius;
+        unsigned long rays, r, missed, brute, baked;
+        unsigned long long rng = 88172645463325252ULL;
+        const unsigned int *runs;
+        unsigned char *seen, *inSet;
+        int side, si, sj, errors = 0, nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+        double a;
+        if (argc < 3) {
+                fprintf(stderr, "usage : %s side firstSeed [lastSeed [raysPerCell]]\n",
+                        argv[0]);
+                return 1;
+        }
+        side = atoi(argv[1]);
+        first = strtoul(argv[2], NULL, 10);
+        last = argc > 3 ? strtoul(argv[3], NULL, 10) : first;
+        rays = argc > 4 ? strtoul(argv[4], NULL, 10) : 100000;
+        if (side < 3 || !(side & 1)) {
+                fprintf(stderr, "side must be odd and at least 3\n");
+                return 1;
+        }
+        radius = pvsRadius(side, PLANE_SCALE);
+        seen = memCalloc(MEM_PVS, side * side, 1);
+        inSet = memCalloc(MEM_PVS, side * side, 1);
+        if (!seen || !inSet) {
+                fprintf(stderr, "not enough memory to check %d x %d\n", side, side);
+                return 1;
+        }
+        for (seed = first; seed <= last && seed >= first; ++seed) {
+                /* same generation as initLevel() in window.c */
+                srand(seed);
+                lab = labyrinth(side, side);
+                if (pvsBake(&pvs, lab, side, radius, nthreads) < 0) {
+                        fprintf(stderr, "not enough memory to bake %d x %d\n", side, side);
+                        return 1;
+                }
+                missed = brute = baked = 0;
+                for (sj = 0; sj < side; ++sj)
+                        for (si = 0; si < side; ++si) {
+                                if (lab[sj * side + si] == WALL)
+                                        continue;
+                                for (r = 0; r < rays; ++r) {
+                                        a = 2.0 * M_PI * uniform(&rng);
+                                        castRay(lab, side, radius, seen, si, sj,
+                                                si + uniform(&rng), sj + uniform(&rng), cos(a),
+                                                sin(a));
+                                }
+                                runs = pvsCell(&pvs, sj * side + si, &nruns);
+                                for (k = 0; k < nruns; ++k)
+                                        for (c = runs[2 * k]; c < runs[2 * k] + runs[2 * k + 1];
+                                             ++c, ++baked)
+                                                inSet[c] = 1;
+                                for (c = 0; c < (unsigned int)(side * side); ++c) {
+                                        brute += seen[c];
+                                        if (seen[c] && !inSet[c]) {
+                                                if (missed++ < 10)
+                                                        fprintf(stderr,
+                                                                "seed %u : cell (%d, %d) sees "
+                                                                "(%u, %u), missing from its set\n",
+                                                                seed, si, sj, c % side, c / side);
+                                        }
+                                        seen[c] = inSet[c] = 0;
+                                }
+                        }
+                printf("seed %u : %lu cells seen by rays, %lu in the sets, %lu missed\n", seed,
+                       brute, baked, missed);
+                errors += missed > 0;
+                pvsFree(&pvs);
+                memFree(lab);
+        }
+        memFree(seen);
+        memFree(inSet);
+        return errors ? 1 : 0;
+}
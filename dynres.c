@@ -0,0 +1,181 @@
+/*!\file dynres.c
+ *
+ * \brief Dynamic resolution.
+ *
+ * The interval between two frames is measured at each drBegin. Timer
+ * queries would exclude the buffer swap wait, but software rasterizers
+ * (the hosts this is for) only rasterize at the flush and report
+ * next to nothing. Fill cost goes with the pixel count, so when the
+ * smoothed time leaves the band [DR_LOW x budget, budget] the scale is
+ * set to bring it back to DR_TARGET x budget, assuming a cost in
+ * scale². The scale moves by DR_STEP steps ; after a change, the
+ * frames still in flight at the previous scale (DR_DROP) are ignored
+ * and DR_SETTLE frames are needed before the next change. Together
+ * with the band, this keeps the scale from oscillating between two
+ * steps. With vertical synchronization, the budget should be above
+ * the refresh period, or frames waiting for it look too slow.
+ *
+ * The scene is rendered in the bottom left part of an offscreen target
+ * sized like the window, so changing the scale allocates nothing, then
+ * upscaled to the window by a linear blit. Anything drawn after drEnd
+ * (the overlays) stays at the window resolution.
+ */
+#include "dynres.h"
+#include "memtrack.h"
+#include <math.h>
+
+/*!\brief scale bounds and step */
+#define DR_MIN 0.5f
+#define DR_STEP (1.0f / 16.0f)
+/*!\brief below budget x DR_LOW the scale goes up ; a new scale aims
+ * at budget x DR_TARGET */
+#define DR_LOW 0.75
+#define DR_TARGET 0.875
+/*!\brief frames ignored after a change, frames at a scale before it
+ * can change again, and weight of a new frame in the smoothed time */
+#define DR_DROP 2
+#define DR_SETTLE 10
+#define DR_SMOOTH 0.25
+
+/*!\brief offscreen target, bound by drBegin */
+static GLuint _fbo = 0, _colorTex = 0, _depthTex = 0;
+static GLboolean _bound = GL_FALSE;
+/*!\brief window size and scene size of the current frame */
+static int _w = 0, _h = 0;
+static GLint _sw = 0, _sh = 0;
+static GLfloat _scale = 1.0f;
+/*!\brief budget (0 : fixed full resolution), smoothed and last frame
+ * times and start of the current frame, in milliseconds */
+static GLdouble _budget = 0.0, _frame = 0.0, _last = 0.0, _t0 = -1.0;
+/*!\brief frames at the current scale, scale changes */
+static GLuint _settle = 0, _changes = 0;
+
+static void createTarget(void) {
+        glGenTextures(1, &_colorTex);
+        glBindTexture(GL_TEXTURE_2D, _colorTex);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, _w, _h, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glGenTextures(1, &_depthTex);
+        glBindTexture(GL_TEXTURE_2D, _depthTex);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, _w, _h, 0, GL_DEPTH_COMPONENT,
+                     GL_UNSIGNED_INT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        memGLAlloc(MEM_TARGET, _colorTex, (size_t)_w * _h * 4);
+        memGLAlloc(MEM_TARGET, _depthTex, (size_t)_w * _h * 4);
+        glGenFramebuffers(1, &_fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, _fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _colorTex, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, _depthTex, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+static void destroyTarget(void) {
+        if (!_fbo)
+                return;
+        glDeleteFramebuffers(1, &_fbo);
+        memGLFree(MEM_TARGET, _colorTex);
+        memGLFree(MEM_TARGET, _depthTex);
+        glDeleteTextures(1, &_colorTex);
+        glDeleteTextures(1, &_depthTex);
+        _fbo = _colorTex = _depthTex = 0;
+}
+
+/*!\brief takes \a ms, the time of the last frame, and changes the
+ * scale if needed. */
+static void adjust(GLdouble ms) {
+        GLfloat s;
+        _last = ms;
+        if (++_settle <= DR_DROP)
+                return;
+        _frame = _settle > DR_DROP + 1 ? _frame + DR_SMOOTH * (ms - _frame) : ms;
+        if (_settle < DR_SETTLE || _budget <= 0.0)
+                return;
+        if (_frame <= _budget && (_frame >= _budget * DR_LOW || _scale >= 1.0f))
+                return;
+        s = floorf(_scale * sqrt(_budget * DR_TARGET / _frame) / DR_STEP) * DR_STEP;
+        if (_frame > _budget && s >= _scale)
+                s = _scale - DR_STEP;
+        s = s < DR_MIN ? DR_MIN : s > 1.0f ? 1.0f : s;
+        if (s == _scale)
+                return;
+        _scale = s;
+        _settle = 0;
+        ++_changes;
+}
+
+/*!\brief sets the frame time budget to \a ms milliseconds ; 0 renders
+ * at the window resolution and releases the offscreen target. */
+void drSetBudget(GLdouble ms) {
+        _budget = ms > 0.0 ? ms : 0.0;
+        _scale = 1.0f;
+        _settle = 0;
+        if (_budget <= 0.0)
+                destroyTarget();
+        else if (!_fbo && _w)
+                createTarget();
+}
+
+/*!\brief (re)creates the offscreen target at the window size \a w x \a
+ * h (only if a budget is set). */
+void drResize(int w, int h) {
+        if (w == _w && h == _h)
+                return;
+        _w = w;
+        _h = h;
+        destroyTarget();
+        if (_budget > 0.0)
+                createTarget();
+}
+
+/*!\brief starts a frame : measures the previous one and adjusts the
+ * scale. If \a offscreen and the scale is below 1, the offscreen
+ * target is bound with a viewport of the scene size.
+ * \return GL_TRUE if the target is bound. */
+GLboolean drBegin(GLboolean offscreen) {
+        GLdouble t = gl4dGetElapsedTime();
+        if (_t0 >= 0.0)
+                adjust(t - _t0);
+        _t0 = t;
+        _sw = (GLint)(_w * _scale + 0.5f);
+        _sh = (GLint)(_h * _scale + 0.5f);
+        _sw = _sw > 0 ? _sw : 1;
+        _sh = _sh > 0 ? _sh : 1;
+        if (!offscreen || !_fbo || _scale >= 1.0f)
+                return GL_FALSE;
+        glBindFramebuffer(GL_FRAMEBUFFER, _fbo);
+        glViewport(0, 0, _sw, _sh);
+        return _bound = GL_TRUE;
+}
+
+/*!\brief gives the size the scene is rendered at this frame. */
+void drSceneSize(GLint *w, GLint *h) {
+        *w = _sw;
+        *h = _sh;
+}
+
+/*!\brief upscales the target to the window, if it was bound. */
+void drEnd(void) {
+        if (!_bound)
+                return;
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, _fbo);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, _sw, _sh, 0, 0, _w, _h, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, _w, _h);
+        _bound = GL_FALSE;
+}
+
+void drStats(drstats_t *stats) {
+        stats->scale = _scale;
+        stats->budget = _budget;
+        stats->frame = _frame;
+        stats->last = _last;
+        stats->changes = _changes;
+}
+
+void drClean(void) {
+        destroyTarget();
+        _bound = GL_FALSE;
+        _w = _h = 0;
+}
@@ -0,0 +1,27 @@
+/*!\file dynres.h
+ *
+ * \brief Dynamic resolution : the scene is rendered at a scale of the
+ * window adjusted to hold a frame time budget, then upscaled.
+ */
+#ifndef DYNRES_H
+#define DYNRES_H
+#include <GL4D/gl4du.h>
+
+/*!\brief current scale, budget, smoothed and last frame times (in
+ * milliseconds) and number of scale changes */
+typedef struct drstats_t drstats_t;
+struct drstats_t {
+        GLfloat scale;
+        GLdouble budget, frame, last;
+        GLuint changes;
+};
+
+void drSetBudget(GLdouble ms);
+void drResize(int w, int h);
+GLboolean drBegin(GLboolean offscreen);
+void drSceneSize(GLint *w, GLint *h);
+void drEnd(void);
+void drStats(drstats_t *stats);
+void drClean(void);
+
+#endif
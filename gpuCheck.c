@@ -0,0 +1,276 @@
+/*!\file gpuCheck.c
+ *
+ * \brief Headless tool checking the GPU-driven culling (gpucull.c) of
+ * the labyrinth generated from a seed, without a window : it runs on
+ * an EGL surfaceless display (Mesa), so it works on build machines.
+ *
+ * From random floor cells and directions, each view is drawn :
+ * - with the visible flags invalidated, so that nothing is occluded :
+ *   the walls and balls kept must be the ones whose bounding sphere
+ *   meets the frustum, as computed on the CPU (up to a tolerance for
+ *   borderline instances), this is the reference image ;
+ * - twice more, the second time with the flags of the same view, which
+ *   must keep at most as many and give exactly the reference image : an
+ *   occluded instance is never visible ;
+ * - after a view moved by up to a cell and turned by up to 30 degrees
+ *   away, which must give the reference image too : the flags of
+ *   another view may only change which phase draws an instance.
+ * Exits with 1 on any error.
+ *
+ * usage : gpuCheck seed [side [views]] (from the directory of shaders/)
+ */
+#include "gpucull.h"
+#include "memtrack.h"
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*!\brief must match _planeScale in window.c (see bakePVS.c) */
+#define PLANE_SCALE 100.0f
+#define WIDTH 320
+#define HEIGHT 240
+/*!\brief relative tolerance on the bounding sphere radius : instances
+ * within it of a plane may be kept or not */
+#define TOLERANCE 1e-3
+#define WALL ((unsigned int)-1)
+
+/* from makeLabyrinth.c */
+extern unsigned int *labyrinth(int w, int h);
+
+/*!\brief makes current an OpenGL 4.3 core context drawing to a
+ * WIDTH x HEIGHT pbuffer of the surfaceless platform.
+ * \return 0 on success, -1 otherwise. */
+static int initEGL(void) {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+                (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        EGLint configAttribs[] = {EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE,
+                                  EGL_OPENGL_BIT, EGL_RED_SIZE, 8, EGL_DEPTH_SIZE, 24, EGL_NONE};
+        EGLint surfaceAttribs[] = {EGL_WIDTH, WIDTH, EGL_HEIGHT, HEIGHT, EGL_NONE};
+        EGLint contextAttribs[] = {EGL_CONTEXT_MAJOR_VERSION, 4, EGL_CONTEXT_MINOR_VERSION, 3,
+                                   EGL_CONTEXT_OPENGL_PROFILE_MASK,
+                                   EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE};
+        EGLDisplay dpy;
+        EGLConfig config;
+        EGLSurface surface;
+        EGLContext context;
+        EGLint n;
+        if (!getPlatformDisplay)
+                return -1;
+        dpy = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        if (dpy == EGL_NO_DISPLAY || !eglInitialize(dpy, NULL, NULL) ||
+            !eglBindAPI(EGL_OPENGL_API) || !eglChooseConfig(dpy, configAttribs, &config, 1, &n) ||
+            !n)
+                return -1;
+        surface = eglCreatePbufferSurface(dpy, config, surfaceAttribs);
+        context = eglCreateContext(dpy, config, EGL_NO_CONTEXT, contextAttribs);
+        if (surface == EGL_NO_SURFACE || context == EGL_NO_CONTEXT ||
+            !eglMakeCurrent(dpy, surface, surface, context))
+                return -1;
+        return 0;
+}
+
+/*!\brief row-major view-projection of the camera at (x, 3, z) looking
+ * horizontally along (-sin theta, 0, -cos theta), with the projection
+ * of resize() in window.c. */
+static void camera(GLfloat *vp, GLfloat x, GLfloat z, GLfloat theta) {
+        GLfloat t = 0.5f * HEIGHT / WIDTH, n = 1.0f, f = PLANE_SCALE + 1.0f;
+        GLfloat fx = -sinf(theta), fz = -cosf(theta);
+        /* right = forward x up, up = (0, 1, 0) */
+        GLfloat p[16] = {2 * n, 0, 0, 0, 0, n / t, 0, 0, 0, 0, -(f + n) / (f - n),
+                         -2 * f * n / (f - n), 0, 0, -1, 0};
+        GLfloat v[16] = {-fz, 0, fx, -(-fz * x + fx * z), 0, 1, 0, -3.0f, -fx, 0, -fz,
+                         fx * x + fz * z, 0, 0, 0, 1};
+        int i, j, k;
+        for (i = 0; i < 4; ++i)
+                for (j = 0; j < 4; ++j)
+                        for (k = 0, vp[4 * i + j] = 0; k < 4; ++k)
+                                vp[4 * i + j] += p[4 * i + k] * v[4 * k + j];
+}
+
+/*!\brief counts in \a in and \a out the spheres (x, y, z, radius r)
+ * meeting the frustum of \a vp for a radius grown, resp. shrunk, by
+ * TOLERANCE : the count of cull.cs must lie between the two. */
+static void frustum(const GLfloat *vp, double x, double y, double z, double r, GLuint *in,
+                    GLuint *out) {
+        double pl[4], l, d;
+        int k, c, grown = 1, shrunk = 1;
+        for (k = 0; k < 6; ++k) {
+                for (c = 0; c < 4; ++c)
+                        pl[c] = vp[12 + c] + ((k & 1) ? -1.0 : 1.0) * vp[(k >> 1) * 4 + c];
+                l = sqrt(pl[0] * pl[0] + pl[1] * pl[1] + pl[2] * pl[2]);
+                d = (pl[0] * x + pl[1] * y + pl[2] * z + pl[3]) / l;
+                grown &= d >= -r * (1.0 + TOLERANCE);
+                shrunk &= d >= -r * (1.0 - TOLERANCE);
+        }
+        *in += grown;
+        *out += shrunk;
+}
+
+/*!\brief a 1 x 1 texture of color \a rgba */
+static GLuint texture(GLuint rgba) {
+        GLuint id;
+        glGenTextures(1, &id);
+        glBindTexture(GL_TEXTURE_2D, id);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, &rgba);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return id;
+}
+
+/*!\brief number of pixels that differ between images \a a and \a b */
+static GLuint differ(const GLuint *a, const GLuint *b) {
+        GLuint j, n;
+        for (j = 0, n = 0; j < WIDTH * HEIGHT; ++j)
+                n += a[j] != b[j];
+        return n;
+}
+
+/*!\brief culls and draws the view \a vp, keeps its image in \a pixels
+ * and its counters in \a st. */
+static void drawView(const GLfloat *vp, GLuint wallTex, GLuint ballTex, GLuint *pixels,
+                     gpustats_t *st) {
+        gpuBegin(WIDTH, HEIGHT);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        gpuDraw(vp, wallTex, ballTex);
+        glReadPixels(0, 0, WIDTH, HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        gpuEnd();
+        gpuStats(st);
+}
+
+int main(int argc, char **argv) {
+        unsigned int seed, side = 15, views = 200, *lab, *walls, v, i, c, nwalls = 0;
+        unsigned int nballs = 0, errors = 0;
+        GLfloat unit, radius, *bx, *bz, x, z, theta, vp[16], moved[16];
+        GLuint wallTex, ballTex, *frustumOnly, *occlusion, in, out, n;
+        double sumFrustum = 0.0, sumOcclusion = 0.0;
+        gpustats_t st, sto, stm;
+        if (argc < 2) {
+                fprintf(stderr, "usage : %s seed [side [views]]\n", argv[0]);
+                return 1;
+        }
+        seed = strtoul(argv[1], NULL, 10);
+        if (argc > 2)
+                side = strtoul(argv[2], NULL, 10);
+        if (argc > 3)
+                views = strtoul(argv[3], NULL, 10);
+        if (side < 3 || !(side & 1)) {
+                fprintf(stderr, "side must be odd and at least 3\n");
+                return 1;
+        }
+        if (initEGL() < 0) {
+                fprintf(stderr, "can't create a surfaceless OpenGL 4.3 context\n");
+                return 1;
+        }
+        if (!gpuInit()) {
+                fprintf(stderr, "GPU-driven culling unavailable (%s)\n",
+                        glGetString(GL_VERSION));
+                return 1;
+        }
+        /* same generation as initLevel() in window.c, a ball every
+         * third floor cell */
+        srand(seed);
+        lab = labyrinth(side, side);
+        unit = 2.0f * PLANE_SCALE / side;
+        radius = (PLANE_SCALE / side) / 4;
+        walls = memMalloc(MEM_LEVEL, side * side * sizeof *walls);
+        bx = memMalloc(MEM_PICKUPS, side * side * sizeof *bx);
+        bz = memMalloc(MEM_PICKUPS, side * side * sizeof *bz);
+        frustumOnly = memMalloc(MEM_RENDER, WIDTH * HEIGHT * sizeof *frustumOnly);
+        occlusion = memMalloc(MEM_RENDER, WIDTH * HEIGHT * sizeof *occlusion);
+        if (!walls || !bx || !bz || !frustumOnly || !occlusion) {
+                fprintf(stderr, "not enough memory to check %u x %u\n", side, side);
+                return 1;
+        }
+        for (c = 0; c < side * side; ++c)
+                if (lab[c] == WALL)
+                        walls[nwalls++] = c;
+                else if (c % 3 == 0) {
+                        bx[nballs] = (c % side) * unit - PLANE_SCALE + unit / 2;
+                        bz[nballs++] = -((c / side) * unit - PLANE_SCALE + unit / 2);
+                }
+        gpuResize(WIDTH, HEIGHT);
+        gpuStageWalls(walls, nwalls, side, PLANE_SCALE);
+        gpuStageBalls(bx, bz, nballs, nballs, radius);
+        while (!gpuStageStep(1 << 16))
+                ;
+        gpuSwap();
+        wallTex = texture(0xFF0000FF);
+        ballTex = texture(0xFF00FFFF);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glEnable(GL_CULL_FACE);
+        glEnable(GL_DEPTH_TEST);
+        for (v = 0; v < views; ++v) {
+                /* a random point of a random floor cell */
+                do
+                        c = rand() % (side * side);
+                while (lab[c] == WALL);
+                x = (c % side + 0.1f + 0.8f * rand() / RAND_MAX) * unit - PLANE_SCALE;
+                z = -((c / side + 0.1f + 0.8f * rand() / RAND_MAX) * unit - PLANE_SCALE);
+                theta = 2.0f * M_PI * rand() / RAND_MAX;
+                camera(vp, x, z, theta);
+                gpuInvalidate();
+                drawView(vp, wallTex, ballTex, frustumOnly, &st);
+                for (i = 0, in = out = 0; i < nwalls; ++i)
+                        frustum(vp, (walls[i] % side) * unit - PLANE_SCALE + unit / 2, 0.0,
+                                -((walls[i] / side) * unit - PLANE_SCALE + unit / 2),
+                                sqrt(2.0 * (PLANE_SCALE / side) * (PLANE_SCALE / side) + 16.0),
+                                &in, &out);
+                if (st.visibleWalls > in || st.visibleWalls < out) {
+                        fprintf(stderr, "view %u : %u walls in the frustum, %u to %u expected\n",
+                                v, st.visibleWalls, out, in);
+                        ++errors;
+                }
+                for (i = 0, in = out = 0; i < nballs; ++i)
+                        frustum(vp, bx[i], 2.0, bz[i], sqrt(2.0 * radius * radius + 1.0), &in,
+                                &out);
+                if (st.visibleBalls > in || st.visibleBalls < out) {
+                        fprintf(stderr, "view %u : %u balls in the frustum, %u to %u expected\n",
+                                v, st.visibleBalls, out, in);
+                        ++errors;
+                }
+                /* the flags of the same view : the first frame draws all of
+                 * the reference in phase 1, the second one only the instances
+                 * visible in the first */
+                drawView(vp, wallTex, ballTex, occlusion, &sto);
+                drawView(vp, wallTex, ballTex, occlusion, &sto);
+                if (sto.visibleWalls > st.visibleWalls || sto.visibleBalls > st.visibleBalls) {
+                        fprintf(stderr, "view %u : occlusion culling kept more instances\n", v);
+                        ++errors;
+                }
+                if ((n = differ(frustumOnly, occlusion)) != 0) {
+                        fprintf(stderr, "view %u : %u pixels differ once occluded instances "
+                                "are culled\n", v, n);
+                        ++errors;
+                }
+                /* the flags of a moved and turned view */
+                camera(moved, x + unit * (2.0f * rand() / RAND_MAX - 1.0f),
+                       z + unit * (2.0f * rand() / RAND_MAX - 1.0f),
+                       theta + (M_PI / 6) * (2.0f * rand() / RAND_MAX - 1.0f));
+                gpuInvalidate();
+                drawView(moved, wallTex, ballTex, occlusion, &stm);
+                drawView(vp, wallTex, ballTex, occlusion, &stm);
+                if ((n = differ(frustumOnly, occlusion)) != 0) {
+                        fprintf(stderr, "view %u : %u pixels differ after the moved view\n", v,
+                                n);
+                        ++errors;
+                }
+                sumFrustum += st.visibleWalls + st.visibleBalls;
+                sumOcclusion += sto.visibleWalls + sto.visibleBalls;
+        }
+        printf("seed %u : %u views, %u instances, %.1f in the frustum and %.1f not occluded "
+               "on average, %u errors\n", seed, views, nwalls + nballs,
+               views ? sumFrustum / views : 0.0, views ? sumOcclusion / views : 0.0, errors);
+        glDeleteTextures(1, &wallTex);
+        glDeleteTextures(1, &ballTex);
+        gpuClean();
+        memFree(lab);
+        memFree(walls);
+        memFree(bx);
+        memFree(bz);
+        memFree(frustumOnly);
+        memFree(occlusion);
+        return errors ? 1 : 0;
+}
@@ -0,0 +1,548 @@
+/*!\file gpucull.c
+ *
+ * \brief GPU-driven drawing of the walls and balls.
+ *
+ * Every wall and ball is an instance (center, half extents, type)
+ * stored once in a shader storage buffer, with a flag telling if it
+ * was visible last frame. Each frame is drawn in two phases by the
+ * cull.cs compute pass, which appends the instances kept to the
+ * visible list of their indirect command :
+ * - phase 1 keeps the instances visible last frame that meet the
+ *   frustum, and draws them ;
+ * - the hierarchical-Z pyramid (farthest depth per texel) is built
+ *   from that depth ;
+ * - phase 2 tests every instance in the frustum against the pyramid,
+ *   draws the ones not occluded that phase 1 did not draw, and updates
+ *   the flags.
+ * The pyramid always holds geometry of the current frame, so an
+ * instance is only culled when it is hidden from the current view ;
+ * the flags only decide what is drawn first. The visible list is also
+ * the per instance vertex attribute, so one glMultiDrawElementsIndirect
+ * per phase draws them all. The CPU cost is a constant number of
+ * calls, whatever the labyrinth size.
+ *
+ * A new level is staged, uploaded in chunks into back buffers
+ * (gpuStageStep) and swapped in at once, so it can be streamed over
+ * several frames while the previous one is still drawn.
+ *
+ * The scene is rendered in an offscreen framebuffer whose depth
+ * texture feeds hiz.cs between the phases, then blitted to the window ; with dynamic
+ * resolution it only covers part of it and is upscaled. Needs OpenGL 4.3
+ * (compute shaders, storage buffers, indirect multi-draw).
+ */
+#include "gpucull.h"
+#include "memtrack.h"
+#include "mesh.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*!\brief an indirect draw command, as read by glMultiDrawElementsIndirect */
+typedef struct command_t command_t;
+struct command_t {
+        GLuint count, instanceCount, firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+};
+
+/*!\brief an instance, as read by cull.cs and inst.vs */
+typedef struct instance_t instance_t;
+struct instance_t {
+        GLfloat pos[4], scale[4];
+};
+
+/*!\brief programs and their cached uniform locations */
+static GLuint _cullPId = 0, _hizPId = 0, _drawPId = 0;
+static GLint _cullVP, _cullPlanes, _cullN, _cullLevels, _cullPhase, _cullHizSize;
+static GLint _hizLevel, _hizSize, _drawVP;
+/*!\brief meshes, instances, their flags, visible list
+ * and commands */
+static GLuint _vao = 0, _vbo = 0, _ibo = 0, _instances = 0, _flags = 0, _visible = 0;
+static GLuint _commands = 0;
+/*!\brief commands with zero instances, copied each frame before
+ * culling : walls and balls of phase 1, then of phase 2 */
+static command_t _cmd[4];
+/*!\brief instance counts of the current level and room for them */
+static GLuint _nwalls = 0, _nballs = 0, _room = 0;
+
+/*!\brief a level being uploaded : what to build the instances from,
+ * how many are uploaded and its back buffers */
+typedef struct stage_t stage_t;
+struct stage_t {
+        const GLuint *walls;
+        const GLfloat *x, *z;
+        GLuint side, nwalls, nballs, capacity, done;
+        GLfloat planeScale, radius;
+        GLuint instances, flags, visible;
+};
+static stage_t _stage;
+/*!\brief offscreen framebuffer and hierarchical-Z pyramid, sized like
+ * the window ; the scene covers its bottom left _sw x _sh part */
+static GLuint _fbo = 0, _colorTex = 0, _depthTex = 0, _hizTex = 0;
+static int _w = 0, _h = 0, _hizLevels = 0;
+static int _sw = 0, _sh = 0;
+
+/*!\brief compiles and links the compute shader of file \a filename
+ * (gl4duCreateProgram handles graphic stages only). */
+static GLuint computeProgram(const char *filename) {
+        FILE *f;
+        long size;
+        char *src, log[1024];
+        GLuint sId, pId;
+        GLint ok;
+        if ((f = fopen(filename, "rb")) == NULL) {
+                fprintf(stderr, "can't open file %s\n", filename);
+                return 0;
+        }
+        fseek(f, 0, SEEK_END);
+        size = ftell(f);
+        rewind(f);
+        src = memCalloc(MEM_RENDER, size + 1, 1);
+        if (fread(src, 1, size, f) != (size_t)size)
+                size = 0;
+        fclose(f);
+        sId = glCreateShader(GL_COMPUTE_SHADER);
+        glShaderSource(sId, 1, (const GLchar **)&src, NULL);
+        glCompileShader(sId);
+        memFree(src);
+        pId = glCreateProgram();
+        glAttachShader(pId, sId);
+        glLinkProgram(pId);
+        glDeleteShader(sId);
+        glGetProgramiv(pId, GL_LINK_STATUS, &ok);
+        if (!ok) {
+                glGetProgramInfoLog(pId, sizeof log, NULL, log);
+                fprintf(stderr, "%s : %s\n", filename, log);
+                glDeleteProgram(pId);
+                return 0;
+        }
+        return pId;
+}
+
+/*!\brief creates the vertex array : the meshes of mesh.c and the per
+ * instance visible list. */
+static void initMesh(void) {
+        mesh_t m[MESH_COUNT];
+        int i;
+        _vao = meshCreate(&_vbo, &_ibo, m);
+        /* the visible list is bound by gpuSwap */
+        glBindVertexArray(_vao);
+        glEnableVertexAttribArray(3);
+        glVertexAttribDivisor(3, 1);
+        glBindVertexArray(0);
+        for (i = 0; i < 4; i += 2) {
+                _cmd[i].count = m[MESH_CUBE].count;
+                _cmd[i].firstIndex = m[MESH_CUBE].firstIndex;
+                _cmd[i].baseVertex = m[MESH_CUBE].baseVertex;
+                _cmd[i + 1].count = m[MESH_SPHERE].count;
+                _cmd[i + 1].firstIndex = m[MESH_SPHERE].firstIndex;
+                _cmd[i + 1].baseVertex = m[MESH_SPHERE].baseVertex;
+        }
+}
+
+/*!\brief checks the OpenGL version, creates the programs, the mesh
+ * and the buffers. \return GL_FALSE if the GPU-driven path is not
+ * available (OpenGL < 4.3 or shader errors). */
+GLboolean gpuInit(void) {
+        GLint major = 0, minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        if (major < 4 || (major == 4 && minor < 3))
+                return GL_FALSE;
+        _cullPId = computeProgram("shaders/cull.cs");
+        _hizPId = computeProgram("shaders/hiz.cs");
+        _drawPId = gl4duCreateProgram("<vs>shaders/inst.vs", "<fs>shaders/inst.fs", NULL);
+        if (!_cullPId || !_hizPId || !_drawPId) {
+                gpuClean();
+                return GL_FALSE;
+        }
+        _cullVP = glGetUniformLocation(_cullPId, "viewProjection");
+        _cullPlanes = glGetUniformLocation(_cullPId, "planes");
+        _cullN = glGetUniformLocation(_cullPId, "ninstances");
+        _cullLevels = glGetUniformLocation(_cullPId, "hizLevels");
+        _cullPhase = glGetUniformLocation(_cullPId, "phase");
+        _cullHizSize = glGetUniformLocation(_cullPId, "hizSize");
+        _hizLevel = glGetUniformLocation(_hizPId, "srcLevel");
+        _hizSize = glGetUniformLocation(_hizPId, "srcSize");
+        _drawVP = glGetUniformLocation(_drawPId, "viewProjection");
+        glUseProgram(_cullPId);
+        glUniform1i(glGetUniformLocation(_cullPId, "hiz"), 0);
+        glUseProgram(_hizPId);
+        glUniform1i(glGetUniformLocation(_hizPId, "src"), 0);
+        glUseProgram(_drawPId);
+        glUniform1i(glGetUniformLocation(_drawPId, "wallTex"), 0);
+        glUniform1i(glGetUniformLocation(_drawPId, "ballTex"), 1);
+        glUseProgram(0);
+        initMesh();
+        glGenBuffers(1, &_commands);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _commands);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof _cmd, _cmd, GL_DYNAMIC_DRAW);
+        memGLAlloc(MEM_BUFFER, _commands, sizeof _cmd);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        return GL_TRUE;
+}
+
+/*!\brief fills \a it with instance \a k of the staged level : walls
+ * placed and scaled as drawWall() in window.c does, then balls. */
+static void stagedInstance(GLuint k, instance_t *it) {
+        GLfloat unit = (_stage.planeScale * 2.0f) / _stage.side;
+        if (k < _stage.nwalls) {
+                GLuint i = _stage.walls[k] % _stage.side, j = _stage.walls[k] / _stage.side;
+                it->pos[0] = (i * unit) - _stage.planeScale + unit / 2;
+                it->pos[1] = 0.0f;
+                it->pos[2] = -((j * unit) - _stage.planeScale + unit / 2);
+                it->pos[3] = 0.0f;
+                it->scale[0] = it->scale[2] = _stage.planeScale / _stage.side;
+                it->scale[1] = 4.0f;
+        } else {
+                k -= _stage.nwalls;
+                it->pos[0] = _stage.x[k];
+                it->pos[1] = 2.0f;
+                it->pos[2] = _stage.z[k];
+                it->pos[3] = 1.0f;
+                it->scale[0] = it->scale[2] = _stage.radius;
+                it->scale[1] = 1.0f;
+        }
+        it->scale[3] = 0.0f;
+}
+
+/*!\brief stages the \a nwalls wall cells \a walls of a labyrinth of
+ * side \a side spanning [-planeScale, planeScale] ; they are uploaded
+ * by gpuStageStep and drawn after gpuSwap. \a walls must stay valid
+ * until then. */
+void gpuStageWalls(const GLuint *walls, GLuint nwalls, GLuint side, GLfloat planeScale) {
+        _stage.walls = walls;
+        _stage.nwalls = nwalls;
+        _stage.side = side;
+        _stage.planeScale = planeScale;
+        _stage.done = 0;
+}
+
+/*!\brief stages the \a n balls of positions (\a x, \a z) and
+ * horizontal radius \a radius, with room for \a capacity balls (see
+ * gpuStageWalls). */
+void gpuStageBalls(const GLfloat *x, const GLfloat *z, GLuint n, GLuint capacity,
+                   GLfloat radius) {
+        _stage.x = x;
+        _stage.z = z;
+        _stage.nballs = n;
+        _stage.capacity = capacity;
+        _stage.radius = radius;
+        _stage.done = 0;
+}
+
+/*!\brief uploads about \a maxBytes more of the staged instances (at
+ * least one) ; the first call allocates the back buffers, with no
+ * instance visible last frame.
+ * \return GL_TRUE when all are uploaded. */
+GLboolean gpuStageStep(GLsizeiptr maxBytes) {
+        GLuint total = _stage.nwalls + _stage.nballs, n, k;
+        instance_t *chunk;
+        if (!_stage.instances) {
+                GLsizeiptr room = _stage.nwalls + _stage.capacity;
+                glGenBuffers(1, &_stage.instances);
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, _stage.instances);
+                glBufferData(GL_SHADER_STORAGE_BUFFER, room * sizeof(instance_t), NULL,
+                             GL_DYNAMIC_DRAW);
+                memGLAlloc(MEM_BUFFER, _stage.instances, room * sizeof(instance_t));
+                glGenBuffers(1, &_stage.flags);
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, _stage.flags);
+                glBufferData(GL_SHADER_STORAGE_BUFFER, room * sizeof(GLuint), NULL,
+                             GL_DYNAMIC_DRAW);
+                glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER,
+                                  GL_UNSIGNED_INT, NULL);
+                memGLAlloc(MEM_BUFFER, _stage.flags, room * sizeof(GLuint));
+                /* one list per phase */
+                glGenBuffers(1, &_stage.visible);
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, _stage.visible);
+                glBufferData(GL_SHADER_STORAGE_BUFFER, 2 * room * sizeof(GLuint), NULL,
+                             GL_DYNAMIC_DRAW);
+                memGLAlloc(MEM_BUFFER, _stage.visible, 2 * room * sizeof(GLuint));
+        }
+        n = maxBytes / sizeof *chunk > 0 ? maxBytes / sizeof *chunk : 1;
+        if (n > total - _stage.done)
+                n = total - _stage.done;
+        if (n) {
+                chunk = memMalloc(MEM_RENDER, n * sizeof *chunk);
+                for (k = 0; k < n; ++k)
+                        stagedInstance(_stage.done + k, &chunk[k]);
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, _stage.instances);
+                glBufferSubData(GL_SHADER_STORAGE_BUFFER, _stage.done * sizeof *chunk,
+                                n * sizeof *chunk, chunk);
+                memFree(chunk);
+                _stage.done += n;
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        return _stage.done == total;
+}
+
+/*!\brief draws the staged level from now on (all of it must have been
+ * uploaded) and releases the buffers of the previous one. */
+void gpuSwap(void) {
+        if (_instances) {
+                memGLFree(MEM_BUFFER, _instances);
+                glDeleteBuffers(1, &_instances);
+        }
+        if (_flags) {
+                memGLFree(MEM_BUFFER, _flags);
+                glDeleteBuffers(1, &_flags);
+        }
+        if (_visible) {
+                memGLFree(MEM_BUFFER, _visible);
+                glDeleteBuffers(1, &_visible);
+        }
+        _instances = _stage.instances;
+        _flags = _stage.flags;
+        _visible = _stage.visible;
+        _nwalls = _stage.nwalls;
+        _nballs = _stage.nballs;
+        _room = _stage.nwalls + _stage.capacity;
+        _cmd[0].baseInstance = 0;
+        _cmd[1].baseInstance = _nwalls;
+        _cmd[2].baseInstance = _room;
+        _cmd[3].baseInstance = _room + _nwalls;
+        glBindVertexArray(_vao);
+        glBindBuffer(GL_ARRAY_BUFFER, _visible);
+        glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, 0, (const void *)0);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        memset(&_stage, 0, sizeof _stage);
+}
+
+/*!\brief re-uploads the \a n remaining balls of the current level
+ * (positions \a x, \a z, horizontal radius \a radius). Their flags
+ * are kept : a wrong one only moves a ball from a phase to the other. */
+void gpuSetBalls(const GLfloat *x, const GLfloat *z, GLuint n, GLfloat radius) {
+        instance_t *b;
+        GLuint i;
+        b = memMalloc(MEM_RENDER, (n ? n : 1) * sizeof *b);
+        for (i = 0; i < n; ++i) {
+                b[i].pos[0] = x[i];
+                b[i].pos[1] = 2.0f;
+                b[i].pos[2] = z[i];
+                b[i].pos[3] = 1.0f;
+                b[i].scale[0] = b[i].scale[2] = radius;
+                b[i].scale[1] = 1.0f;
+                b[i].scale[3] = 0.0f;
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _instances);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, _nwalls * sizeof *b, n * sizeof *b, b);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        _nballs = n;
+        memFree(b);
+}
+
+/*!\brief bytes of a w x h R32F mipmap chain */
+static size_t hizBytes(int w, int h) {
+        size_t n = 0;
+        for (;;) {
+                n += (size_t)w * h * 4;
+                if (w == 1 && h == 1)
+                        return n;
+                w = w > 1 ? w / 2 : 1;
+                h = h > 1 ? h / 2 : 1;
+        }
+}
+
+/*!\brief (re)creates the offscreen framebuffer and the pyramid at the
+ * window size. */
+void gpuResize(int w, int h) {
+        int s;
+        if (w == _w && h == _h)
+                return;
+        _w = w;
+        _h = h;
+        if (_fbo) {
+                glDeleteFramebuffers(1, &_fbo);
+                memGLFree(MEM_TARGET, _colorTex);
+                memGLFree(MEM_TARGET, _depthTex);
+                memGLFree(MEM_TARGET, _hizTex);
+                glDeleteTextures(1, &_colorTex);
+                glDeleteTextures(1, &_depthTex);
+                glDeleteTextures(1, &_hizTex);
+        }
+        for (_hizLevels = 1, s = w > h ? w : h; s > 1; s >>= 1)
+                ++_hizLevels;
+        glGenTextures(1, &_colorTex);
+        glBindTexture(GL_TEXTURE_2D, _colorTex);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, w, h);
+        glGenTextures(1, &_depthTex);
+        glBindTexture(GL_TEXTURE_2D, _depthTex);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, w, h);
+        glGenTextures(1, &_hizTex);
+        glBindTexture(GL_TEXTURE_2D, _hizTex);
+        glTexStorage2D(GL_TEXTURE_2D, _hizLevels, GL_R32F, w, h);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        memGLAlloc(MEM_TARGET, _colorTex, (size_t)w * h * 4);
+        memGLAlloc(MEM_TARGET, _depthTex, (size_t)w * h * 4);
+        memGLAlloc(MEM_TARGET, _hizTex, hizBytes(w, h));
+        glGenFramebuffers(1, &_fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, _fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _colorTex, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, _depthTex, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+/*!\brief redirects the scene rendering to the offscreen framebuffer,
+ * at \a w x \a h (at most the window size, see dynres.c). */
+void gpuBegin(int w, int h) {
+        _sw = w < _w ? w : _w;
+        _sh = h < _h ? h : _h;
+        glBindFramebuffer(GL_FRAMEBUFFER, _fbo);
+        glViewport(0, 0, _sw, _sh);
+}
+
+/*!\brief runs cull.cs phase \a phase (1 or 2) for the view of the
+ * row-major matrix \a m of frustum planes \a planes. */
+static void cull(int phase, const GLfloat *m, GLfloat planes[6][4]) {
+        GLuint n = _nwalls + _nballs;
+        glUseProgram(_cullPId);
+        glUniformMatrix4fv(_cullVP, 1, GL_TRUE, m);
+        glUniform4fv(_cullPlanes, 6, &planes[0][0]);
+        glUniform1ui(_cullN, n);
+        glUniform1i(_cullPhase, phase);
+        glUniform1i(_cullLevels, _hizLevels);
+        glUniform2i(_cullHizSize, _sw, _sh);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, _hizTex);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, _instances);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, _visible);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, _commands);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, _flags);
+        glDispatchCompute((n + 63) / 64, 1, 1);
+        glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT |
+                        GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+/*!\brief draws the walls and balls kept by cull.cs phase \a phase. */
+static void draw(int phase, const GLfloat *m, GLuint wallTexId, GLuint ballTexId) {
+        glUseProgram(_drawPId);
+        glUniformMatrix4fv(_drawVP, 1, GL_TRUE, m);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, wallTexId);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, ballTexId);
+        glActiveTexture(GL_TEXTURE0);
+        glBindVertexArray(_vao);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                    (const void *)((phase - 1) * 2 * sizeof(command_t)), 2, 0);
+        glBindVertexArray(0);
+}
+
+/*!\brief builds the pyramid from the depth drawn so far. */
+static void buildHiz(void) {
+        int l, sw = _sw, sh = _sh, w = _sw, h = _sh;
+        glUseProgram(_hizPId);
+        glActiveTexture(GL_TEXTURE0);
+        for (l = 0; l < _hizLevels; ++l) {
+                glBindTexture(GL_TEXTURE_2D, l ? _hizTex : _depthTex);
+                glUniform1i(_hizLevel, l - 1);
+                glUniform2i(_hizSize, sw, sh);
+                glBindImageTexture(0, _hizTex, l, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+                glDispatchCompute((w + 7) / 8, (h + 7) / 8, 1);
+                glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+                sw = w;
+                sh = h;
+                w = w > 1 ? w / 2 : 1;
+                h = h > 1 ? h / 2 : 1;
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+/*!\brief culls then draws the walls and balls seen through the row-major
+ * matrix \a viewProjection, in two phases (see above) ; what is already
+ * in the depth buffer (e.g. the floor) occludes too. */
+void gpuDraw(const GLfloat *viewProjection, GLuint wallTexId, GLuint ballTexId) {
+        const GLfloat *m = viewProjection;
+        GLfloat planes[6][4];
+        int k, c;
+        if (!_instances)
+                return;
+        /* frustum planes : row 3 +/- rows 0, 1 and 2 */
+        for (k = 0; k < 6; ++k) {
+                GLfloat s = (k & 1) ? -1.0f : 1.0f, l;
+                for (c = 0; c < 4; ++c)
+                        planes[k][c] = m[12 + c] + s * m[(k >> 1) * 4 + c];
+                l = sqrtf(planes[k][0] * planes[k][0] + planes[k][1] * planes[k][1] +
+                          planes[k][2] * planes[k][2]);
+                for (c = 0; c < 4; ++c)
+                        planes[k][c] /= l;
+        }
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _commands);
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof _cmd, _cmd);
+        cull(1, m, planes);
+        draw(1, m, wallTexId, ballTexId);
+        buildHiz();
+        cull(2, m, planes);
+        draw(2, m, wallTexId, ballTexId);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+/*!\brief blits (upscales) the scene to the window. */
+void gpuEnd(void) {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, _fbo);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, _sw, _sh, 0, 0, _w, _h, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, _w, _h);
+}
+
+/*!\brief forgets which instances were visible : the next frame draws
+ * nothing in phase 1, so phase 2 tests all of them against the depth
+ * drawn before gpuDraw only. */
+void gpuInvalidate(void) {
+        if (!_flags)
+                return;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _flags);
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT,
+                          NULL);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+/*!\brief reads back the counters of the last frame, both phases
+ * (stalls, for monitoring only). */
+void gpuStats(gpustats_t *stats) {
+        command_t cmd[4];
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _commands);
+        glGetBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof cmd, cmd);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        stats->walls = _nwalls;
+        stats->balls = _nballs;
+        stats->visibleWalls = cmd[0].instanceCount + cmd[2].instanceCount;
+        stats->visibleBalls = cmd[1].instanceCount + cmd[3].instanceCount;
+}
+
+void gpuClean(void) {
+        GLuint *buffers[] = {&_instances,       &_flags,       &_visible,       &_commands,
+                             &_stage.instances, &_stage.flags, &_stage.visible};
+        GLuint *textures[] = {&_colorTex, &_depthTex, &_hizTex};
+        int i;
+        for (i = 0; i < 7; ++i)
+                if (*buffers[i]) {
+                        memGLFree(MEM_BUFFER, *buffers[i]);
+                        glDeleteBuffers(1, buffers[i]);
+                        *buffers[i] = 0;
+                }
+        for (i = 0; i < 3; ++i)
+                if (*textures[i]) {
+                        memGLFree(MEM_TARGET, *textures[i]);
+                        glDeleteTextures(1, textures[i]);
+                        *textures[i] = 0;
+                }
+        meshDelete(&_vao, &_vbo, &_ibo);
+        if (_fbo)
+                glDeleteFramebuffers(1, &_fbo);
+        if (_cullPId)
+                glDeleteProgram(_cullPId);
+        if (_hizPId)
+                glDeleteProgram(_hizPId);
+        _fbo = _cullPId = _hizPId = _drawPId = 0;
+        _w = _h = _sw = _sh = 0;
+        memset(&_stage, 0, sizeof _stage);
+        _nwalls = _nballs = _room = 0;
+}
@@ -0,0 +1,31 @@
+/*!\file gpucull.h
+ *
+ * \brief GPU-driven drawing of the walls and balls : culled by a
+ * compute pass and drawn by an indirect multi-draw, in two phases.
+ */
+#ifndef GPUCULL_H
+#define GPUCULL_H
+#include <GL4D/gl4du.h>
+
+/*!\brief instances submitted and kept by the last frame */
+typedef struct gpustats_t gpustats_t;
+struct gpustats_t {
+        GLuint walls, balls, visibleWalls, visibleBalls;
+};
+
+GLboolean gpuInit(void);
+void gpuStageWalls(const GLuint *walls, GLuint nwalls, GLuint side, GLfloat planeScale);
+void gpuStageBalls(const GLfloat *x, const GLfloat *z, GLuint n, GLuint capacity,
+                   GLfloat radius);
+GLboolean gpuStageStep(GLsizeiptr maxBytes);
+void gpuSwap(void);
+void gpuSetBalls(const GLfloat *x, const GLfloat *z, GLuint n, GLfloat radius);
+void gpuResize(int w, int h);
+void gpuBegin(int w, int h);
+void gpuDraw(const GLfloat *viewProjection, GLuint wallTexId, GLuint ballTexId);
+void gpuEnd(void);
+void gpuInvalidate(void);
+void gpuStats(gpustats_t *stats);
+void gpuClean(void);
+
+#endif
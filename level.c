@@ -0,0 +1,157 @@
+/*!\file level.c
+ *
+ * \brief Generation of a level.
+ *
+ * Everything the simulation needs is built here without OpenGL, so a
+ * level can be generated on a worker thread while the previous one is
+ * played ; window.c then uploads it and swaps it in at once. labyrinth()
+ * and the ball placement draw from rand(), whose sequence is shared by
+ * the whole process : generations hold _randLock from srand() to the
+ * last draw, so the same seed always gives the same level.
+ */
+#include "level.h"
+#include "memtrack.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WALL ((unsigned int)-1)
+
+/* from makeLabyrinth.c */
+extern unsigned int *labyrinth(int w, int h);
+
+/*!\brief parameters and result of the background generation */
+typedef struct job_t job_t;
+struct job_t {
+        level_t *l;
+        unsigned int seed, side;
+        float planeScale;
+        unsigned int pvsRadius;
+        int sdfRes, nthreads, ret, done;
+};
+
+static pthread_mutex_t _randLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t _worker;
+static job_t _job;
+static int _running = 0;
+
+/*!\brief seed of level \a n of a session seeded by \a seed (level 0
+ * uses \a seed itself). */
+unsigned int levelSeed(unsigned int seed, unsigned int n) {
+        return seed + n * 2654435761u;
+}
+
+/*!\brief places the balls : about one free cell out of five. */
+static int initBalls(level_t *l, float planeScale) {
+        unsigned int i, j, n = 0, side = l->side;
+        float unit = (planeScale * 2.0f) / side;
+        /* at most one ball per free cell, the pool never grows */
+        for (i = 0; i < side * side; i++)
+                if (l->lab[i] != WALL)
+                        n++;
+        if (pickupsInit(&l->balls, n) < 0)
+                return -1;
+        for (j = 0; j < side; j++)
+                for (i = 0; i < side; i++)
+                        if (l->lab[j * side + i] != WALL) {
+                                srand(l->seed + i + j);
+                                if (rand() % 10 > 7)
+                                        pickupsAdd(&l->balls, (i * unit) - planeScale + unit / 2,
+                                                   -((j * unit) - planeScale + unit / 2));
+                        }
+        return 0;
+}
+
+/*!\brief generates level \a l of side \a side from \a seed : the
+ * labyrinth, its balls, the wall list, the collision field (\a sdfRes
+ * nodes per cell) and, if \a pvsRadius is not 0, the visible sets for
+ * this radius, both built with \a nthreads threads.
+ * \return 0 on success, -1 otherwise. */
+int levelBuild(level_t *l, unsigned int seed, unsigned int side, float planeScale,
+               int sdfRes, unsigned int pvsRadius, int nthreads) {
+        unsigned int i;
+        int ret;
+        memset(l, 0, sizeof *l);
+        l->seed = seed;
+        l->side = side;
+        pthread_mutex_lock(&_randLock);
+        srand(seed);
+        l->lab = labyrinth(side, side);
+        ret = initBalls(l, planeScale);
+        pthread_mutex_unlock(&_randLock);
+        if (ret < 0)
+                goto error;
+        for (i = 0; i < side * side; ++i)
+                l->nwalls += l->lab[i] == WALL;
+        l->walls = memMalloc(MEM_LEVEL, (l->nwalls ? l->nwalls : 1) * sizeof *l->walls);
+        if (!l->walls)
+                goto error;
+        for (i = 0, l->nwalls = 0; i < side * side; ++i)
+                if (l->lab[i] == WALL)
+                        l->walls[l->nwalls++] = i;
+        if (sdfBuild(&l->sdf, l->lab, side, planeScale, sdfRes, nthreads) < 0)
+                goto error;
+        if (pvsRadius) {
+                if (pvsBake(&l->pvs, l->lab, side, pvsRadius, nthreads) < 0)
+                        goto error;
+                l->pvs.seed = seed;
+        }
+        return 0;
+error:
+        levelFree(l);
+        return -1;
+}
+
+static void *workerThread(void *arg) {
+        job_t *j = arg;
+        j->ret = levelBuild(j->l, j->seed, j->side, j->planeScale, j->sdfRes, j->pvsRadius,
+                            j->nthreads);
+        __atomic_store_n(&j->done, 1, __ATOMIC_RELEASE);
+        return NULL;
+}
+
+/*!\brief starts generating \a l on the worker thread (see levelBuild).
+ * \a l must not be accessed before levelWait.
+ * \return 0 on success, -1 if a generation is running or the thread
+ * can't be created. */
+int levelBuildAsync(level_t *l, unsigned int seed, unsigned int side, float planeScale,
+                    int sdfRes, unsigned int pvsRadius, int nthreads) {
+        if (_running)
+                return -1;
+        _job.l = l;
+        _job.seed = seed;
+        _job.side = side;
+        _job.planeScale = planeScale;
+        _job.sdfRes = sdfRes;
+        _job.pvsRadius = pvsRadius;
+        _job.nthreads = nthreads;
+        _job.done = 0;
+        if (pthread_create(&_worker, NULL, workerThread, &_job))
+                return -1;
+        _running = 1;
+        return 0;
+}
+
+/*!\brief tells, without blocking, if the running generation is over. */
+int levelReady(void) {
+        return _running && __atomic_load_n(&_job.done, __ATOMIC_ACQUIRE);
+}
+
+/*!\brief waits for the running generation.
+ * \return its levelBuild result, -1 if none was running. */
+int levelWait(void) {
+        if (!_running)
+                return -1;
+        pthread_join(_worker, NULL);
+        _running = 0;
+        return _job.ret;
+}
+
+void levelFree(level_t *l) {
+        memFree(l->lab);
+        pickupsFree(&l->balls);
+        sdfFree(&l->sdf);
+        pvsFree(&l->pvs);
+        memFree(l->walls);
+        memset(l, 0, sizeof *l);
+}
@@ -0,0 +1,34 @@
+/*!\file level.h
+ *
+ * \brief Generation of a level (labyrinth, balls, collision field),
+ * synchronous or on a worker thread.
+ */
+#ifndef LEVEL_H
+#define LEVEL_H
+#include "pickups.h"
+#include "pvs.h"
+#include "sdf.h"
+
+/*!\brief CPU side of a level. walls lists the wall cells, which is
+ * what the GPU instances are built from ; pvs is empty unless asked
+ * for. */
+typedef struct level_t level_t;
+struct level_t {
+        unsigned int seed, side;
+        unsigned int *lab;
+        pickups_t balls;
+        sdf_t sdf;
+        pvs_t pvs;
+        unsigned int *walls, nwalls;
+};
+
+unsigned int levelSeed(unsigned int seed, unsigned int n);
+int levelBuild(level_t *l, unsigned int seed, unsigned int side, float planeScale,
+               int sdfRes, unsigned int pvsRadius, int nthreads);
+int levelBuildAsync(level_t *l, unsigned int seed, unsigned int side, float planeScale,
+                    int sdfRes, unsigned int pvsRadius, int nthreads);
+int levelReady(void);
+int levelWait(void);
+void levelFree(level_t *l);
+
+#endif
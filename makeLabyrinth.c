@@ -6,6 +6,7 @@
  * \date February 20 2018
  */
 #include <assert.h>
+#include "memtrack.h"
 #include <stdlib.h>
 
 static void propoagate(int *lab, int v, int x, int y, int w, int *n) {
@@ -26,7 +27,7 @@ unsigned int *labyrinth(int w, int h) {
         int *lab, toGo = sw * sh - 1;
         int mx, my, d;
         assert((w & 1) && (h & 1));
-        lab = malloc(w * h * sizeof *lab);
+        lab = memMalloc(MEM_LEVEL, w * h * sizeof *lab);
         assert(lab);
         for (i = 0; i < h; ++i)
                 for (j = 0; j < w; ++j)
@@ -0,0 +1,52 @@
+/*!\file mazeStats.c
+ *
+ * \brief Tool printing the measures of the labyrinths generated from
+ * a range of seeds, one line per seed, to tune or filter levels.
+ *
+ * usage : mazeStats side firstSeed [lastSeed]
+ */
+#include "analytics.h"
+#include "memtrack.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/* from makeLabyrinth.c */
+extern unsigned int *labyrinth(int w, int h);
+
+int main(int argc, char **argv) {
+        mazestats_t st;
+        unsigned int seed, first, last, *lab;
+        int side, nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+        struct timespec t0, t1;
+        if (argc < 3) {
+                fprintf(stderr, "usage : %s side firstSeed [lastSeed]\n", argv[0]);
+                return 1;
+        }
+        side = atoi(argv[1]);
+        first = strtoul(argv[2], NULL, 10);
+        last = argc > 3 ? strtoul(argv[3], NULL, 10) : first;
+        printf("# seed cells deadEnds junctions deg1 deg2 deg3 deg4 corridors avgCorridor "
+               "solution diameter ms\n");
+        for (seed = first; seed <= last && seed >= first; ++seed) {
+                /* same generation as initLevel() in window.c */
+                srand(seed);
+                lab = labyrinth(side, side);
+                clock_gettime(CLOCK_MONOTONIC, &t0);
+                /* from the top-left room to the bottom-right one */
+                if (mazeStats(lab, side, side, side + 1, (long long)side * (side - 1) - 2,
+                              nthreads, &st) < 0) {
+                        fprintf(stderr, "not enough memory to measure %d x %d\n", side, side);
+                        return 1;
+                }
+                clock_gettime(CLOCK_MONOTONIC, &t1);
+                printf("%u %llu %llu %llu %llu %llu %llu %llu %llu %.2f %lld %lld %.1f\n", seed,
+                       st.cells, st.deadEnds, st.junctions, st.degree[1], st.degree[2],
+                       st.degree[3], st.degree[4], st.corridors, st.avgCorridor, st.solution,
+                       st.diameter,
+                       (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6);
+                memFree(lab);
+        }
+        return 0;
+}
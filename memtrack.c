@@ -0,0 +1,218 @@
+/*!\file memtrack.c
+ *
+ * \brief Accounting of the CPU allocations and GPU resources.
+ *
+ * CPU blocks carry a small header (size and category) in front of the
+ * returned pointer, so memFree knows what to subtract. The counters
+ * are updated atomically : levels are generated on a worker thread.
+ * GPU resources can't carry a header ; they are kept in a table
+ * indexed by category and GL name, with the byte size given by the
+ * caller. The table is only used by the thread owning the GL context.
+ */
+#include "memtrack.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*!\brief bytes in front of each block, keeps the malloc alignment */
+#define HEADER 16
+
+typedef struct header_t header_t;
+struct header_t {
+        size_t size;
+        int cat;
+};
+
+/*!\brief live and peak bytes, live objects, allocations and frees */
+typedef struct counter_t counter_t;
+struct counter_t {
+        long long live, peak, count, allocs, frees;
+};
+
+typedef struct resource_t resource_t;
+struct resource_t {
+        unsigned int id;
+        int cat;
+        size_t bytes;
+};
+
+static const char *_names[MEM_NCATS] = {"level",    "pickups", "sdf",     "pvs",       "render",
+                                        "textures", "targets", "buffers", "geometries"};
+static counter_t _cats[MEM_NCATS];
+/*!\brief live and peak totals, CPU then GPU */
+static long long _live[2], _peak[2];
+/*!\brief live objects and bytes at the last checkpoint */
+static long long _markCount[MEM_NCATS], _markLive[MEM_NCATS];
+static char _markWhat[32] = "";
+/*!\brief live GPU resources */
+static resource_t *_res = NULL;
+static size_t _nres = 0, _maxRes = 0;
+
+static void raisePeak(long long *peak, long long v) {
+        long long p = __atomic_load_n(peak, __ATOMIC_RELAXED);
+        while (v > p &&
+               !__atomic_compare_exchange_n(peak, &p, v, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                ;
+}
+
+/*!\brief adds \a bytes and \a objects (+1 creation, -1 deletion, 0
+ * resize) to category \a cat. */
+static void account(int cat, long long bytes, int objects) {
+        counter_t *c = &_cats[cat];
+        int gpu = cat >= MEM_GPU;
+        long long live = __atomic_add_fetch(&c->live, bytes, __ATOMIC_RELAXED);
+        if (bytes > 0)
+                raisePeak(&c->peak, live);
+        if (objects) {
+                __atomic_add_fetch(&c->count, objects, __ATOMIC_RELAXED);
+                __atomic_add_fetch(objects > 0 ? &c->allocs : &c->frees, 1, __ATOMIC_RELAXED);
+        }
+        live = __atomic_add_fetch(&_live[gpu], bytes, __ATOMIC_RELAXED);
+        if (bytes > 0)
+                raisePeak(&_peak[gpu], live);
+}
+
+/*!\brief malloc accounted in category \a cat ; free with memFree. */
+void *memMalloc(int cat, size_t size) {
+        header_t *h = malloc(HEADER + size);
+        if (!h)
+                return NULL;
+        h->size = size;
+        h->cat = cat;
+        account(cat, size, 1);
+        return (char *)h + HEADER;
+}
+
+/*!\brief calloc accounted in category \a cat ; free with memFree. */
+void *memCalloc(int cat, size_t n, size_t size) {
+        header_t *h;
+        if (size && n > ((size_t)-1 - HEADER) / size)
+                return NULL;
+        if ((h = calloc(1, HEADER + n * size)) == NULL)
+                return NULL;
+        h->size = n * size;
+        h->cat = cat;
+        account(cat, n * size, 1);
+        return (char *)h + HEADER;
+}
+
+/*!\brief realloc of a block from memMalloc, memCalloc or memRealloc ;
+ * the block keeps its category, \a cat is used when \a p is NULL. */
+void *memRealloc(int cat, void *p, size_t size) {
+        header_t *h, *nh;
+        size_t old;
+        if (!p)
+                return memMalloc(cat, size);
+        h = (header_t *)((char *)p - HEADER);
+        old = h->size;
+        if ((nh = realloc(h, HEADER + size)) == NULL)
+                return NULL;
+        nh->size = size;
+        account(nh->cat, (long long)size - (long long)old, 0);
+        return (char *)nh + HEADER;
+}
+
+void memFree(void *p) {
+        header_t *h;
+        if (!p)
+                return;
+        h = (header_t *)((char *)p - HEADER);
+        account(h->cat, -(long long)h->size, -1);
+        free(h);
+}
+
+static resource_t *findResource(int cat, unsigned int id) {
+        size_t i;
+        for (i = 0; i < _nres; ++i)
+                if (_res[i].id == id && _res[i].cat == cat)
+                        return &_res[i];
+        return NULL;
+}
+
+/*!\brief records that GL object \a id of category \a cat now holds \a
+ * bytes (creation, or new storage of an existing object). */
+void memGLAlloc(int cat, unsigned int id, size_t bytes) {
+        resource_t *r;
+        size_t max;
+        if (!id)
+                return;
+        if ((r = findResource(cat, id)) != NULL) {
+                account(cat, (long long)bytes - (long long)r->bytes, 0);
+                r->bytes = bytes;
+                return;
+        }
+        if (_nres == _maxRes) {
+                max = _maxRes ? 2 * _maxRes : 64;
+                /* out of memory, the object is not accounted at all */
+                if ((r = realloc(_res, max * sizeof *_res)) == NULL)
+                        return;
+                _res = r;
+                _maxRes = max;
+        }
+        r = &_res[_nres++];
+        r->id = id;
+        r->cat = cat;
+        r->bytes = bytes;
+        account(cat, bytes, 1);
+}
+
+/*!\brief records the deletion of GL object \a id of category \a cat. */
+void memGLFree(int cat, unsigned int id) {
+        resource_t *r = findResource(cat, id);
+        if (!r)
+                return;
+        account(cat, -(long long)r->bytes, -1);
+        *r = _res[--_nres];
+        if (!_nres) {
+                free(_res);
+                _res = NULL;
+                _maxRes = 0;
+        }
+}
+
+/*!\brief reports the categories that grew since the previous
+ * checkpoint, then makes this one (named \a what) the reference. Two
+ * checkpoints taken in the same state (e.g. after two level swaps)
+ * should see no growth. The size of the visible sets depends on the
+ * labyrinth, so only their object count is compared. */
+void memCheckpoint(const char *what) {
+        int c;
+        long long count, live;
+        for (c = 0; c < MEM_NCATS; ++c) {
+                count = __atomic_load_n(&_cats[c].count, __ATOMIC_RELAXED);
+                live = __atomic_load_n(&_cats[c].live, __ATOMIC_RELAXED);
+                if (*_markWhat &&
+                    (count > _markCount[c] || (c != MEM_PVS && live > _markLive[c])))
+                        fprintf(stderr,
+                                "memory: %s grew by %lld bytes, %lld objects from %s to %s\n",
+                                _names[c], live - _markLive[c], count - _markCount[c],
+                                _markWhat, what);
+                _markCount[c] = count;
+                _markLive[c] = live;
+        }
+        strncpy(_markWhat, what, sizeof _markWhat - 1);
+}
+
+/*!\brief prints the live and peak bytes of each category and in total. */
+void memReport(FILE *f) {
+        int c;
+        fprintf(f, "%-11s %12s %12s %8s %8s %8s\n", "memory", "live", "peak", "objects",
+                "allocs", "frees");
+        for (c = 0; c < MEM_NCATS; ++c)
+                fprintf(f, "%-11s %12lld %12lld %8lld %8lld %8lld\n", _names[c], _cats[c].live,
+                        _cats[c].peak, _cats[c].count, _cats[c].allocs, _cats[c].frees);
+        fprintf(f, "%-11s %12lld %12lld\n%-11s %12lld %12lld\n", "cpu", _live[0], _peak[0], "gpu",
+                _live[1], _peak[1]);
+}
+
+/*!\brief flags the categories still holding objects (to be called
+ * once everything has been released). \return their number. */
+int memLeaks(FILE *f) {
+        int c, n = 0;
+        for (c = 0; c < MEM_NCATS; ++c)
+                if (_cats[c].count || _cats[c].live) {
+                        fprintf(f, "memory leak: %lld %s objects (%lld bytes) never released\n",
+                                _cats[c].count, _names[c], _cats[c].live);
+                        ++n;
+                }
+        return n;
+}
@@ -0,0 +1,36 @@
+/*!\file memtrack.h
+ *
+ * \brief Accounting of the CPU allocations and GPU resources, by
+ * category.
+ */
+#ifndef MEMTRACK_H
+#define MEMTRACK_H
+#include <stddef.h>
+#include <stdio.h>
+
+/*!\brief categories : CPU ones first, then the GPU ones (MEM_GPU) */
+enum memcat_t {
+        MEM_LEVEL = 0, /*!< labyrinth and wall list */
+        MEM_PICKUPS,
+        MEM_SDF,
+        MEM_PVS,
+        MEM_RENDER, /*!< render queue items and upload scratch */
+        MEM_GPU,
+        MEM_TEXTURE = MEM_GPU,
+        MEM_TARGET, /*!< offscreen render targets */
+        MEM_BUFFER,
+        MEM_GEOMETRY, /*!< meshes (mesh.c) */
+        MEM_NCATS
+};
+
+void *memMalloc(int cat, size_t size);
+void *memCalloc(int cat, size_t n, size_t size);
+void *memRealloc(int cat, void *p, size_t size);
+void memFree(void *p);
+void memGLAlloc(int cat, unsigned int id, size_t bytes);
+void memGLFree(int cat, unsigned int id);
+void memCheckpoint(const char *what);
+void memReport(FILE *f);
+int memLeaks(FILE *f);
+
+#endif
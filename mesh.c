@@ -0,0 +1,145 @@
+/*!\file mesh.c
+ *
+ * \brief Quad, cube and sphere meshes.
+ *
+ * The three meshes share one vertex buffer (position, normal and
+ * texture coordinates, attributes 0 to 2) and one index buffer ; a
+ * mesh is a range of indices relative to its base vertex. Unlike
+ * GL4Dummies geometries, their draw parameters are known, so a caller
+ * can draw many instances of a mesh with one call.
+ */
+#include "mesh.h"
+#include "memtrack.h"
+#include <math.h>
+
+/*!\brief tessellation of the sphere (slices around y, stacks along y) */
+#define SPHERE_SLICES 5
+#define SPHERE_STACKS 5
+#define QUAD_VERTICES 4
+#define QUAD_INDICES 6
+#define CUBE_VERTICES 24
+#define CUBE_INDICES 36
+#define SPHERE_VERTICES ((SPHERE_SLICES + 1) * (SPHERE_STACKS + 1))
+#define SPHERE_INDICES (6 * SPHERE_SLICES * SPHERE_STACKS)
+
+/*!\brief appends a vertex (position, normal, texture coordinates) */
+static void vertex(GLfloat **v, GLfloat px, GLfloat py, GLfloat pz, GLfloat nx, GLfloat ny,
+                   GLfloat nz, GLfloat s, GLfloat t) {
+        GLfloat *p = *v;
+        p[0] = px;
+        p[1] = py;
+        p[2] = pz;
+        p[3] = nx;
+        p[4] = ny;
+        p[5] = nz;
+        p[6] = s;
+        p[7] = t;
+        *v += 8;
+}
+
+/*!\brief appends the two triangles of the quad \a a, \a b, \a c, \a d
+ * (counter-clockwise) */
+static void quad(GLuint **e, GLuint a, GLuint b, GLuint c, GLuint d) {
+        GLuint *p = *e;
+        p[0] = a;
+        p[1] = b;
+        p[2] = c;
+        p[3] = a;
+        p[4] = c;
+        p[5] = d;
+        *e += 6;
+}
+
+/*!\brief creates the vertex array of the meshes : a [-1, 1] quad
+ * facing +z (as gl4dgGenQuadf), a [-1, 1] cube and a unit sphere, all
+ * with counter-clockwise faces. Sets \a vbo and \a ibo to its buffers
+ * and \a meshes (MESH_COUNT of them) to their draw parameters.
+ * \return the vertex array, left unbound. */
+GLuint meshCreate(GLuint *vbo, GLuint *ibo, mesh_t *meshes) {
+        /* per face normal, then u and v axes with u x v = normal */
+        static const GLfloat faces[6][3][3] = {
+                {{1, 0, 0}, {0, 0, -1}, {0, 1, 0}},  {{-1, 0, 0}, {0, 0, 1}, {0, 1, 0}},
+                {{0, 1, 0}, {1, 0, 0}, {0, 0, -1}},  {{0, -1, 0}, {1, 0, 0}, {0, 0, 1}},
+                {{0, 0, 1}, {1, 0, 0}, {0, 1, 0}},   {{0, 0, -1}, {-1, 0, 0}, {0, 1, 0}}};
+        static const GLfloat corners[4][2] = {{0, 0}, {1, 0}, {1, 1}, {0, 1}};
+        GLuint nv = QUAD_VERTICES + CUBE_VERTICES + SPHERE_VERTICES;
+        GLuint ni = QUAD_INDICES + CUBE_INDICES + SPHERE_INDICES;
+        GLfloat *data = memMalloc(MEM_RENDER, nv * 8 * sizeof *data), *v = data;
+        GLuint *idx = memMalloc(MEM_RENDER, ni * sizeof *idx), *e = idx, vao;
+        int f, k, i, j;
+        meshes[MESH_QUAD].count = QUAD_INDICES;
+        meshes[MESH_QUAD].firstIndex = 0;
+        meshes[MESH_QUAD].baseVertex = 0;
+        meshes[MESH_CUBE].count = CUBE_INDICES;
+        meshes[MESH_CUBE].firstIndex = QUAD_INDICES;
+        meshes[MESH_CUBE].baseVertex = QUAD_VERTICES;
+        meshes[MESH_SPHERE].count = SPHERE_INDICES;
+        meshes[MESH_SPHERE].firstIndex = QUAD_INDICES + CUBE_INDICES;
+        meshes[MESH_SPHERE].baseVertex = QUAD_VERTICES + CUBE_VERTICES;
+        /* the indices of a mesh are relative to its base vertex */
+        for (k = 0; k < 4; ++k)
+                vertex(&v, 2 * corners[k][0] - 1, 2 * corners[k][1] - 1, 0, 0, 0, 1,
+                       corners[k][0], corners[k][1]);
+        quad(&e, 0, 1, 2, 3);
+        for (f = 0; f < 6; ++f) {
+                const GLfloat *n = faces[f][0], *u = faces[f][1], *w = faces[f][2];
+                for (k = 0; k < 4; ++k) {
+                        GLfloat a = 2 * corners[k][0] - 1, b = 2 * corners[k][1] - 1;
+                        vertex(&v, n[0] + a * u[0] + b * w[0], n[1] + a * u[1] + b * w[1],
+                               n[2] + a * u[2] + b * w[2], n[0], n[1], n[2], corners[k][0],
+                               corners[k][1]);
+                }
+                quad(&e, 4 * f, 4 * f + 1, 4 * f + 2, 4 * f + 3);
+        }
+        for (i = 0; i <= SPHERE_STACKS; ++i)
+                for (j = 0; j <= SPHERE_SLICES; ++j) {
+                        GLfloat th = M_PI * i / SPHERE_STACKS, ph = 2.0 * M_PI * j / SPHERE_SLICES;
+                        GLfloat x = sin(th) * sin(ph), y = cos(th), z = sin(th) * cos(ph);
+                        vertex(&v, x, y, z, x, y, z, j / (GLfloat)SPHERE_SLICES,
+                               1.0f - i / (GLfloat)SPHERE_STACKS);
+                }
+        for (i = 0; i < SPHERE_STACKS; ++i)
+                for (j = 0; j < SPHERE_SLICES; ++j) {
+                        GLuint a = i * (SPHERE_SLICES + 1) + j, b = a + SPHERE_SLICES + 1;
+                        quad(&e, a, b, b + 1, a + 1);
+                }
+        glGenVertexArrays(1, &vao);
+        glBindVertexArray(vao);
+        glGenBuffers(1, vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, *vbo);
+        glBufferData(GL_ARRAY_BUFFER, nv * 8 * sizeof *data, data, GL_STATIC_DRAW);
+        memGLAlloc(MEM_GEOMETRY, *vbo, nv * 8 * sizeof *data);
+        glEnableVertexAttribArray(0);
+        glEnableVertexAttribArray(1);
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof *data, (const void *)0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof *data,
+                              (const void *)(3 * sizeof *data));
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof *data,
+                              (const void *)(6 * sizeof *data));
+        glGenBuffers(1, ibo);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, *ibo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, ni * sizeof *idx, idx, GL_STATIC_DRAW);
+        memGLAlloc(MEM_GEOMETRY, *ibo, ni * sizeof *idx);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        memFree(data);
+        memFree(idx);
+        return vao;
+}
+
+/*!\brief deletes the vertex array \a vao of meshCreate and its buffers
+ * \a vbo and \a ibo, and zeroes the three. */
+void meshDelete(GLuint *vao, GLuint *vbo, GLuint *ibo) {
+        if (*vbo) {
+                memGLFree(MEM_GEOMETRY, *vbo);
+                glDeleteBuffers(1, vbo);
+        }
+        if (*ibo) {
+                memGLFree(MEM_GEOMETRY, *ibo);
+                glDeleteBuffers(1, ibo);
+        }
+        if (*vao)
+                glDeleteVertexArrays(1, vao);
+        *vao = *vbo = *ibo = 0;
+}
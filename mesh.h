@@ -0,0 +1,24 @@
+/*!\file mesh.h
+ *
+ * \brief Quad, cube and sphere meshes stored in one vertex array and
+ * drawn as indexed triangles, so that they can be drawn instanced.
+ */
+#ifndef MESH_H
+#define MESH_H
+#include <GL4D/gl4du.h>
+
+/*!\brief meshes of a vertex array of meshCreate */
+enum meshid_t { MESH_QUAD = 0, MESH_CUBE, MESH_SPHERE, MESH_COUNT };
+
+/*!\brief draw parameters of a mesh (GL_TRIANGLES, GL_UNSIGNED_INT
+ * indices) */
+typedef struct mesh_t mesh_t;
+struct mesh_t {
+        GLuint count, firstIndex;
+        GLint baseVertex;
+};
+
+GLuint meshCreate(GLuint *vbo, GLuint *ibo, mesh_t *meshes);
+void meshDelete(GLuint *vao, GLuint *vbo, GLuint *ibo);
+
+#endif
@@ -0,0 +1,106 @@
+/*!\file pickups.c
+ *
+ * \brief Pool-backed store of the pickups (balls).
+ *
+ * All arrays are allocated once by pickupsInit ; insertion pops a
+ * free slot and appends to the dense arrays, removal moves the last
+ * dense element into the hole and bumps the slot generation. Both are
+ * O(1) and never copy the whole store.
+ */
+#include "pickups.h"
+#include "memtrack.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*!\brief allocates a store able to hold \a capacity pickups.
+ * \return 0 on success, -1 otherwise ; the store is then empty and
+ * full (pickupsAdd fails), never half allocated. */
+int pickupsInit(pickups_t *p, unsigned int capacity) {
+        unsigned int i;
+        memset(p, 0, sizeof *p);
+        p->x = memMalloc(MEM_PICKUPS, capacity * sizeof *p->x);
+        p->z = memMalloc(MEM_PICKUPS, capacity * sizeof *p->z);
+        p->slot = memMalloc(MEM_PICKUPS, capacity * sizeof *p->slot);
+        p->dense = memMalloc(MEM_PICKUPS, capacity * sizeof *p->dense);
+        p->gen = memMalloc(MEM_PICKUPS, capacity * sizeof *p->gen);
+        p->freeSlots = memMalloc(MEM_PICKUPS, capacity * sizeof *p->freeSlots);
+        if (capacity && (!p->x || !p->z || !p->slot || !p->dense || !p->gen ||
+                         !p->freeSlots)) {
+                pickupsFree(p);
+                return -1;
+        }
+        p->capacity = capacity;
+        /* slots are popped in increasing order */
+        for (i = 0; i < capacity; ++i) {
+                p->gen[i] = 1;
+                p->freeSlots[i] = capacity - 1 - i;
+        }
+        p->nfree = capacity;
+        return 0;
+}
+
+void pickupsFree(pickups_t *p) {
+        memFree(p->x);
+        memFree(p->z);
+        memFree(p->slot);
+        memFree(p->dense);
+        memFree(p->gen);
+        memFree(p->freeSlots);
+        memset(p, 0, sizeof *p);
+}
+
+/*!\brief adds a pickup at (\a x, \a z).
+ * \return its handle, the null handle if the store is full. */
+pickup_t pickupsAdd(pickups_t *p, float x, float z) {
+        pickup_t h = {0, 0};
+        unsigned int i = p->count;
+        if (!p->nfree)
+                return h;
+        h.slot = p->freeSlots[--p->nfree];
+        h.gen = p->gen[h.slot];
+        p->x[i] = x;
+        p->z[i] = z;
+        p->slot[i] = h.slot;
+        p->dense[h.slot] = i;
+        ++p->count;
+        return h;
+}
+
+/*!\brief removes the pickup designated by \a h.
+ * \return 1 if it was removed, 0 if the handle was stale. */
+int pickupsRemove(pickups_t *p, pickup_t h) {
+        unsigned int i, last;
+        if (!h.gen || h.slot >= p->capacity || p->gen[h.slot] != h.gen)
+                return 0;
+        i = p->dense[h.slot];
+        last = --p->count;
+        p->x[i] = p->x[last];
+        p->z[i] = p->z[last];
+        p->slot[i] = p->slot[last];
+        p->dense[p->slot[i]] = i;
+        /* skip the null generation on wrap around */
+        if (!++p->gen[h.slot])
+                p->gen[h.slot] = 1;
+        p->freeSlots[p->nfree++] = h.slot;
+        return 1;
+}
+
+/*!\brief gets the position of the pickup designated by \a h.
+ * \return 1 if the handle is valid, 0 otherwise. */
+int pickupsGet(const pickups_t *p, pickup_t h, float *x, float *z) {
+        unsigned int i;
+        if (!h.gen || h.slot >= p->capacity || p->gen[h.slot] != h.gen)
+                return 0;
+        i = p->dense[h.slot];
+        *x = p->x[i];
+        *z = p->z[i];
+        return 1;
+}
+
+/*!\brief handle of the pickup stored at dense index \a i. */
+pickup_t pickupsHandle(const pickups_t *p, unsigned int i) {
+        pickup_t h;
+        h.slot = p->slot[i];
+        h.gen = p->gen[h.slot];
+        return h;
+}
@@ -0,0 +1,37 @@
+/*!\file pickups.h
+ *
+ * \brief Pool-backed store of the pickups (balls) with generational
+ * handles.
+ */
+#ifndef PICKUPS_H
+#define PICKUPS_H
+
+/*!\brief handle to a pickup ; stays valid until the pickup is
+ * removed, then never matches again (generation mismatch). A zero
+ * generation is the null handle. */
+typedef struct pickup_t pickup_t;
+struct pickup_t {
+        unsigned int slot, gen;
+};
+
+/*!\brief pickup store : positions are kept densely packed in SoA
+ * arrays, slots give the indirection used by handles. */
+typedef struct pickups_t pickups_t;
+struct pickups_t {
+        unsigned int capacity, count;
+        /*!\brief dense positions, valid in [0, count) */
+        float *x, *z;
+        /*!\brief dense index to slot */
+        unsigned int *slot;
+        /*!\brief slot to dense index, slot generation and free slots stack */
+        unsigned int *dense, *gen, *freeSlots, nfree;
+};
+
+int pickupsInit(pickups_t *p, unsigned int capacity);
+void pickupsFree(pickups_t *p);
+pickup_t pickupsAdd(pickups_t *p, float x, float z);
+int pickupsRemove(pickups_t *p, pickup_t h);
+int pickupsGet(const pickups_t *p, pickup_t h, float *x, float *z);
+pickup_t pickupsHandle(const pickups_t *p, unsigned int i);
+
+#endif
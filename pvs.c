@@ -0,0 +1,401 @@
+/*!\file pvs.c
+ *
+ * \brief Potentially visible sets baking, saving and loading.
+ *
+ * A cell B is visible from a floor cell A if some line leaving A
+ * reaches B through floor cells only, i.e. stabs every edge (portal)
+ * between the consecutive cells it crosses. For each quadrant of
+ * directions, a depth-first search follows the right and top portals
+ * while keeping the set of lines stabbing all of them so far : a
+ * convex polygon in a 2D line space, clipped by two half-planes per
+ * portal (its ends). Portals are slightly widened, so the sets are a
+ * superset of what is visible from anywhere in A, never a sample of
+ * it ; the only extra cells are the ones seen through the corner two
+ * diagonal walls share. Cells farther than the visibility radius are
+ * never visible.
+ * Baking spreads the source cells over threads.
+ *
+ * File layout : magic, version, seed, side, radius, then for every
+ * cell its number of runs followed by (gap since the end of the
+ * previous run, length) pairs, all written as LEB128 varints.
+ */
+#include "pvs.h"
+#include "memtrack.h"
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PVS_MAGIC "GLPV"
+/* 1 : sampled, not conservative */
+#define PVS_VERSION 2
+#define WALL ((unsigned int)-1)
+
+/*!\brief portals are widened by EPS cells, so rounding never drops
+ * a line ; polygons keep at most MAXV vertices */
+#define EPS 1e-4
+#define MAXV 32
+
+typedef struct bake_t bake_t;
+struct bake_t {
+        const unsigned int *lab;
+        int side, radius;
+        /*!\brief next source row to process, set if an allocation failed */
+        int next, failed;
+        pthread_mutex_t mutex;
+        /*!\brief per cell runs (pairs) and number of runs */
+        unsigned int **runs, *nruns;
+};
+
+/*!\brief lines of direction (1 - w, w), w in [0, 1], are the points
+ * of the convex polygon (w, c) where c = (1 - w) y - w x on the line */
+typedef struct poly_t poly_t;
+struct poly_t {
+        int n;
+        double w[MAXV], c[MAXV];
+};
+
+/*!\brief the search of a source cell : its position, the quadrant
+ * (sx, sy) and the visibility bytes to fill */
+typedef struct search_t search_t;
+struct search_t {
+        const bake_t *bk;
+        int si, sj, sx, sy;
+        unsigned char *vis;
+};
+
+/*!\brief keeps the lines of \a p passing on the side \a s of point
+ * (x, y) : s = 1 keeps the ones having it on their left, s = -1 on
+ * their right. \return the number of vertices left (0 : none). */
+static int clip(poly_t *p, double x, double y, double s) {
+        double w[MAXV + 1], c[MAXV + 1], fa, fb, t;
+        int i, k, n = 0;
+        for (i = 0; i < p->n; ++i) {
+                k = (i + 1) % p->n;
+                fa = s * ((1.0 - p->w[i]) * y - p->w[i] * x - p->c[i]);
+                fb = s * ((1.0 - p->w[k]) * y - p->w[k] * x - p->c[k]);
+                if (fa >= 0.0) {
+                        w[n] = p->w[i];
+                        c[n++] = p->c[i];
+                }
+                if ((fa >= 0.0) != (fb >= 0.0)) {
+                        t = fa / (fa - fb);
+                        w[n] = p->w[i] + t * (p->w[k] - p->w[i]);
+                        c[n++] = p->c[i] + t * (p->c[k] - p->c[i]);
+                }
+        }
+        if (n <= MAXV) {
+                memcpy(p->w, w, n * sizeof *w);
+                memcpy(p->c, c, n * sizeof *c);
+                return p->n = n;
+        }
+        /* too many vertices : the bounding box only adds lines, the
+         * sets stay conservative */
+        p->w[0] = p->w[3] = p->w[1] = p->w[2] = w[0];
+        p->c[0] = p->c[1] = p->c[2] = p->c[3] = c[0];
+        for (i = 1; i < n; ++i) {
+                p->w[0] = p->w[3] = w[i] < p->w[0] ? w[i] : p->w[0];
+                p->w[1] = p->w[2] = w[i] > p->w[1] ? w[i] : p->w[1];
+                p->c[0] = p->c[1] = c[i] < p->c[0] ? c[i] : p->c[0];
+                p->c[2] = p->c[3] = c[i] > p->c[2] ? c[i] : p->c[2];
+        }
+        return p->n = 4;
+}
+
+/*!\brief marks the cells reached from floor cell (di, dj), given
+ * relative to the source in the quadrant of the search, by the lines
+ * of \a p (those stabbing every portal from the source to it). In the
+ * quadrant, lines only cross right or top cell edges. */
+static void spread(const search_t *se, int di, int dj, const poly_t *p) {
+        const bake_t *bk = se->bk;
+        int k, ni, nj, ti, tj, r = bk->radius;
+        poly_t q;
+        for (k = 0; k < 2; ++k) {
+                ni = di + !k;
+                nj = dj + k;
+                ti = se->si + se->sx * ni;
+                tj = se->sj + se->sy * nj;
+                if (ti < 0 || tj < 0 || ti >= bk->side || tj >= bk->side || ni > r || nj > r ||
+                    ni * ni + nj * nj > (r + 1) * (r + 1))
+                        continue;
+                q = *p;
+                /* the right edge is crossed below its top end and above
+                 * its bottom end, the top edge right of its left end and
+                 * left of its right end */
+                if (k == 0 ? !clip(&q, ni, dj + 1 + EPS, 1.0) || !clip(&q, ni, dj - EPS, -1.0)
+                           : !clip(&q, di - EPS, nj, 1.0) || !clip(&q, di + 1 + EPS, nj, -1.0))
+                        continue;
+                se->vis[tj * bk->side + ti] = 1;
+                if (bk->lab[tj * bk->side + ti] != WALL)
+                        spread(se, ni, nj, &q);
+        }
+}
+
+/*!\brief marks in \a vis the cells visible from anywhere in floor
+ * cell (si, sj) : those some line reaches through floor cells only. */
+static void visible(const bake_t *bk, unsigned char *vis, int si, int sj) {
+        search_t se = {bk, si, sj, 1, 1, vis};
+        double c = 4.0 * (bk->radius + 2);
+        poly_t p = {4, {0.0, 1.0, 1.0, 0.0}, {-c, -c, c, c}};
+        vis[sj * bk->side + si] = 1;
+        for (se.sx = -1; se.sx <= 1; se.sx += 2)
+                for (se.sy = -1; se.sy <= 1; se.sy += 2)
+                        spread(&se, 0, 0, &p);
+}
+
+/*!\brief converts the visibility bytes of the window around (si, sj)
+ * in runs of consecutive cell indices.
+ * \return 0 on success, -1 if out of memory. */
+static int toRuns(bake_t *bk, const unsigned char *vis, int si, int sj) {
+        int side = bk->side, r = bk->radius, i, j, n = 0, cell = sj * side + si;
+        int i0 = si - r < 0 ? 0 : si - r, i1 = si + r >= side ? side - 1 : si + r;
+        int j0 = sj - r < 0 ? 0 : sj - r, j1 = sj + r >= side ? side - 1 : sj + r;
+        unsigned int *runs =
+                memMalloc(MEM_PVS, (2 * (j1 - j0 + 1) * (i1 - i0 + 1) + 1) * sizeof *runs);
+        if (!runs)
+                return -1;
+        for (j = j0; j <= j1; ++j)
+                for (i = i0; i <= i1; ++i) {
+                        if (!vis[j * side + i])
+                                continue;
+                        if (n && runs[2 * n - 2] + runs[2 * n - 1] == (unsigned int)(j * side + i))
+                                ++runs[2 * n - 1];
+                        else {
+                                runs[2 * n] = j * side + i;
+                                runs[2 * n + 1] = 1;
+                                ++n;
+                        }
+                }
+        /* shrinking, the block is kept if it can't move */
+        bk->runs[cell] = memRealloc(MEM_PVS, runs, (2 * n + 1) * sizeof *runs);
+        if (!bk->runs[cell])
+                bk->runs[cell] = runs;
+        bk->nruns[cell] = n;
+        return 0;
+}
+
+static void *bakeThread(void *arg) {
+        bake_t *bk = arg;
+        int side = bk->side, r = bk->radius, si, sj, ti, tj;
+        unsigned char *vis = memCalloc(MEM_PVS, side * side, 1);
+        for (;;) {
+                pthread_mutex_lock(&bk->mutex);
+                sj = bk->next++;
+                if (!vis)
+                        bk->failed = 1;
+                pthread_mutex_unlock(&bk->mutex);
+                if (sj >= side || !vis)
+                        break;
+                for (si = 0; si < side; ++si) {
+                        if (bk->lab[sj * side + si] == WALL)
+                                continue;
+                        visible(bk, vis, si, sj);
+                        if (toRuns(bk, vis, si, sj) < 0) {
+                                pthread_mutex_lock(&bk->mutex);
+                                bk->failed = 1;
+                                bk->next = side;
+                                pthread_mutex_unlock(&bk->mutex);
+                                break;
+                        }
+                        for (tj = sj - r; tj <= sj + r; ++tj)
+                                for (ti = si - r; ti <= si + r; ++ti)
+                                        if (ti >= 0 && tj >= 0 && ti < side && tj < side)
+                                                vis[tj * side + ti] = 0;
+                }
+        }
+        memFree(vis);
+        return NULL;
+}
+
+/*!\brief visibility radius, in cells, of a labyrinth of side \a side
+ * spanning 2 x \a planeScale with the far plane at \a planeScale + 1
+ * (as in window.c). */
+unsigned int pvsRadius(unsigned int side, double planeScale) {
+        return (unsigned int)ceil((planeScale + 1.0) / (2.0 * planeScale / side)) + 1;
+}
+
+/*!\brief computes the sets of labyrinth \a lab (side \a side, walls
+ * are -1) for a visibility radius of \a radius cells, using \a
+ * nthreads threads. seed is left to the caller.
+ * \return 0 on success, -1 otherwise. */
+int pvsBake(pvs_t *pvs, const unsigned int *lab, unsigned int side,
+            unsigned int radius, int nthreads) {
+        bake_t bk;
+        pthread_t *th;
+        unsigned int c, n = side * side, total = 0;
+        int t;
+        memset(pvs, 0, sizeof *pvs);
+        if (nthreads < 1)
+                nthreads = 1;
+        bk.lab = lab;
+        bk.side = side;
+        bk.radius = radius;
+        bk.next = bk.failed = 0;
+        bk.runs = memCalloc(MEM_PVS, n, sizeof *bk.runs);
+        bk.nruns = memCalloc(MEM_PVS, n, sizeof *bk.nruns);
+        th = memMalloc(MEM_PVS, nthreads * sizeof *th);
+        if (!bk.runs || !bk.nruns || !th) {
+                memFree(bk.runs);
+                memFree(bk.nruns);
+                memFree(th);
+                return -1;
+        }
+        pthread_mutex_init(&bk.mutex, NULL);
+        for (t = 0; t < nthreads; ++t)
+                if (pthread_create(&th[t], NULL, bakeThread, &bk))
+                        break;
+        /* the calling thread bakes alone if none could be created */
+        if ((nthreads = t) == 0)
+                bakeThread(&bk);
+        for (t = 0; t < nthreads; ++t)
+                pthread_join(th[t], NULL);
+        pthread_mutex_destroy(&bk.mutex);
+        memFree(th);
+        /* concatenates the per cell runs */
+        if (!bk.failed) {
+                for (c = 0; c < n; ++c)
+                        total += bk.nruns[c];
+                pvs->offsets = memMalloc(MEM_PVS, (n + 1) * sizeof *pvs->offsets);
+                pvs->runs = memMalloc(MEM_PVS, (2 * (size_t)total + 1) * sizeof *pvs->runs);
+        }
+        if (pvs->offsets && pvs->runs) {
+                pvs->side = side;
+                pvs->radius = radius;
+                for (c = 0, total = 0; c < n; ++c) {
+                        pvs->offsets[c] = total;
+                        if (bk.nruns[c])
+                                memcpy(pvs->runs + 2 * total, bk.runs[c],
+                                       2 * bk.nruns[c] * sizeof *pvs->runs);
+                        total += bk.nruns[c];
+                }
+                pvs->offsets[n] = total;
+        } else
+                pvsFree(pvs);
+        for (c = 0; c < n; ++c)
+                memFree(bk.runs[c]);
+        memFree(bk.runs);
+        memFree(bk.nruns);
+        return pvs->offsets ? 0 : -1;
+}
+
+static void writeVarint(FILE *f, unsigned int v) {
+        while (v >= 0x80) {
+                fputc((v & 0x7F) | 0x80, f);
+                v >>= 7;
+        }
+        fputc(v, f);
+}
+
+static int readVarint(FILE *f, unsigned int *v) {
+        int c, shift = 0;
+        *v = 0;
+        do {
+                if ((c = fgetc(f)) == EOF || shift > 28)
+                        return -1;
+                *v |= (unsigned int)(c & 0x7F) << shift;
+                shift += 7;
+        } while (c & 0x80);
+        return 0;
+}
+
+/*!\return 0 on success, -1 otherwise. */
+int pvsSave(const pvs_t *pvs, const char *filename) {
+        FILE *f;
+        unsigned int c, k, end;
+        if ((f = fopen(filename, "wb")) == NULL) {
+                fprintf(stderr, "can't open file %s for writing\n", filename);
+                return -1;
+        }
+        fwrite(PVS_MAGIC, 1, 4, f);
+        fputc(PVS_VERSION, f);
+        writeVarint(f, pvs->seed);
+        writeVarint(f, pvs->side);
+        writeVarint(f, pvs->radius);
+        for (c = 0; c < pvs->side * pvs->side; ++c) {
+                writeVarint(f, pvs->offsets[c + 1] - pvs->offsets[c]);
+                for (k = pvs->offsets[c], end = 0; k < pvs->offsets[c + 1]; ++k) {
+                        writeVarint(f, pvs->runs[2 * k] - end);
+                        writeVarint(f, pvs->runs[2 * k + 1]);
+                        end = pvs->runs[2 * k] + pvs->runs[2 * k + 1];
+                }
+        }
+        fclose(f);
+        return 0;
+}
+
+/*!\brief loads the sets of \a filename, which must have been baked
+ * for a labyrinth of side \a side : a file is never trusted, the side
+ * is checked before anything is allocated and the runs only take the
+ * memory of the ones actually read.
+ * \return 0 on success, -1 otherwise. */
+int pvsLoad(pvs_t *pvs, const char *filename, unsigned int side) {
+        FILE *f;
+        char magic[4];
+        unsigned int c, k, n, nruns, max = 0, end, gap, *p;
+        memset(pvs, 0, sizeof *pvs);
+        if ((f = fopen(filename, "rb")) == NULL) {
+                fprintf(stderr, "can't open file %s\n", filename);
+                return -1;
+        }
+        if (fread(magic, 1, 4, f) != 4 || memcmp(magic, PVS_MAGIC, 4) ||
+            fgetc(f) != PVS_VERSION || readVarint(f, &pvs->seed) < 0 ||
+            readVarint(f, &pvs->side) < 0 || readVarint(f, &pvs->radius) < 0 ||
+            !pvs->radius || pvs->radius > pvs->side)
+                goto error;
+        if (pvs->side != side) {
+                fprintf(stderr, "%s was baked for side %u, not %u\n", filename, pvs->side, side);
+                goto fail;
+        }
+        n = side * side;
+        if ((pvs->offsets = memMalloc(MEM_PVS, (n + 1) * sizeof *pvs->offsets)) == NULL)
+                goto nomem;
+        pvs->offsets[0] = 0;
+        for (c = 0; c < n; ++c) {
+                /* runs are disjoint and not empty : at most n per cell */
+                if (readVarint(f, &nruns) < 0 || nruns > n ||
+                    nruns > (UINT_MAX >> 3) - pvs->offsets[c])
+                        goto error;
+                pvs->offsets[c + 1] = pvs->offsets[c] + nruns;
+                for (k = pvs->offsets[c], end = 0; k < pvs->offsets[c + 1]; ++k) {
+                        if (k >= max) {
+                                max = 2 * k + 256;
+                                p = memRealloc(MEM_PVS, pvs->runs, 2 * (size_t)max * sizeof *p);
+                                if (!p)
+                                        goto nomem;
+                                pvs->runs = p;
+                        }
+                        if (readVarint(f, &gap) < 0 || readVarint(f, &pvs->runs[2 * k + 1]) < 0 ||
+                            !pvs->runs[2 * k + 1] || gap > n - end ||
+                            pvs->runs[2 * k + 1] > n - end - gap)
+                                goto error;
+                        pvs->runs[2 * k] = end + gap;
+                        end = pvs->runs[2 * k] + pvs->runs[2 * k + 1];
+                }
+        }
+        fclose(f);
+        return 0;
+nomem:
+        fprintf(stderr, "not enough memory to load %s\n", filename);
+        goto fail;
+error:
+        fprintf(stderr, "%s is not a valid PVS file\n", filename);
+fail:
+        fclose(f);
+        pvsFree(pvs);
+        return -1;
+}
+
+/*!\brief gets the runs of cells visible from \a cell.
+ * \return the runs, (first cell, number of cells) pairs. */
+const unsigned int *pvsCell(const pvs_t *pvs, unsigned int cell, unsigned int *nruns) {
+        *nruns = pvs->offsets[cell + 1] - pvs->offsets[cell];
+        return pvs->runs + 2 * pvs->offsets[cell];
+}
+
+void pvsFree(pvs_t *pvs) {
+        memFree(pvs->offsets);
+        memFree(pvs->runs);
+        memset(pvs, 0, sizeof *pvs);
+}
@@ -0,0 +1,33 @@
+/*!\file pvs.h
+ *
+ * \brief Potentially visible sets of a labyrinth : for every cell, the
+ * cells (walls and floor) visible from anywhere in it.
+ *
+ * The sets of the first level are baked offline by bakePVS and loaded
+ * with pvsLoad ; the ones of the next levels are baked at runtime by
+ * pvsBake on the level worker thread (level.c).
+ */
+#ifndef PVS_H
+#define PVS_H
+
+/*!\brief sets of all the cells of a labyrinth, stored as runs of
+ * consecutive cell indices (row-major order). */
+typedef struct pvs_t pvs_t;
+struct pvs_t {
+        /*!\brief seed and side of the labyrinth, visibility radius in cells */
+        unsigned int seed, side, radius;
+        /*!\brief side * side + 1 offsets (in runs) of each cell runs */
+        unsigned int *offsets;
+        /*!\brief pairs (first cell, number of cells) */
+        unsigned int *runs;
+};
+
+unsigned int pvsRadius(unsigned int side, double planeScale);
+int pvsBake(pvs_t *pvs, const unsigned int *lab, unsigned int side,
+            unsigned int radius, int nthreads);
+int pvsSave(const pvs_t *pvs, const char *filename);
+int pvsLoad(pvs_t *pvs, const char *filename, unsigned int side);
+const unsigned int *pvsCell(const pvs_t *pvs, unsigned int cell, unsigned int *nruns);
+void pvsFree(pvs_t *pvs);
+
+#endif
@@ -0,0 +1,340 @@
+/*!\file renderqueue.c
+ *
+ * \brief Sorted render command queue.
+ *
+ * Items are recorded with a sort key made of their layer, render
+ * states, texture and mesh (mesh.c). rqFlush sorts them, writes their
+ * model-view-projection matrix and parameters in one segment of a
+ * uniform buffer ring and then submits them, only changing states and
+ * textures between batches of identical keys. A batch is drawn by one
+ * instanced draw (more if it has over RQ_INSTANCES items) whose
+ * objects are consecutive in the ring, the vertex shader reads its own
+ * with gl_InstanceID. The ring has RQ_FRAMES
+ * segments, each protected by a fence, and is persistently mapped
+ * when buffer storage is supported (GL 4.4 or ARB_buffer_storage),
+ * mapped unsynchronized per frame otherwise.
+ */
+#include "renderqueue.h"
+#include "memtrack.h"
+#include "mesh.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*!\brief number of frames the ring can hold */
+#define RQ_FRAMES 3
+/*!\brief floats per object in the "object" uniform block (mat4 + vec4) */
+#define RQ_OBJECT_FLOATS 20
+/*!\brief objects of the "object" uniform block, as declared in
+ * shaders/basic.vs : 16 KiB (the smallest GL_MAX_UNIFORM_BLOCK_SIZE)
+ * over the object size */
+#define RQ_INSTANCES 204
+#define RQ_BLOCK_BYTES (RQ_INSTANCES * RQ_OBJECT_FLOATS * sizeof(GLfloat))
+
+typedef struct item_t item_t;
+struct item_t {
+        unsigned long long key;
+        GLuint order, state, tex, mesh;
+        GLfloat data[RQ_OBJECT_FLOATS];
+};
+
+/*!\brief recorded items */
+static item_t *_items = NULL;
+static GLuint _nitems = 0, _maxItems = 0;
+/*!\brief current projection * view matrix */
+static GLfloat _pv[16];
+/*!\brief GLSL program Id and uniform buffer ring Id */
+static GLuint _pId = 0, _ubo = 0;
+/*!\brief vertex array of the meshes and their draw parameters */
+static GLuint _vao = 0, _vbo = 0, _ibo = 0;
+static mesh_t _meshes[MESH_COUNT];
+/*!\brief uniform buffer offset alignment, the most bytes an object
+ * takes in the ring (its size aligned) and objects per segment */
+static GLint _align = 0, _stride = 0;
+static GLuint _capacity = 0;
+/*!\brief persistent mapping of the whole ring (NULL if not persistent) */
+static GLubyte *_mapped = NULL;
+static GLboolean _persistent = GL_FALSE;
+/*!\brief one fence per ring segment and current frame */
+static GLsync _fences[RQ_FRAMES];
+static GLuint _frame = 0;
+/*!\brief counters of the last flushed frame */
+static rqstats_t _stats;
+
+/*!\brief row-major 4x4 product r = a * b */
+static void mult(GLfloat *r, const GLfloat *a, const GLfloat *b) {
+        int i, j, k;
+        for (i = 0; i < 4; ++i)
+                for (j = 0; j < 4; ++j) {
+                        r[i * 4 + j] = 0.0f;
+                        for (k = 0; k < 4; ++k)
+                                r[i * 4 + j] += a[i * 4 + k] * b[k * 4 + j];
+                }
+}
+
+static GLboolean hasBufferStorage(void) {
+        GLint major = 0, minor = 0, n = 0, i;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        if (major > 4 || (major == 4 && minor >= 4))
+                return GL_TRUE;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &n);
+        for (i = 0; i < n; ++i)
+                if (!strcmp((const char *)glGetStringi(GL_EXTENSIONS, i),
+                            "GL_ARB_buffer_storage"))
+                        return GL_TRUE;
+        return GL_FALSE;
+}
+
+static void waitFence(GLuint seg) {
+        if (!_fences[seg])
+                return;
+        glClientWaitSync(_fences[seg], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        glDeleteSync(_fences[seg]);
+        _fences[seg] = 0;
+}
+
+/*!\brief creates the ring for \a capacity objects per segment ; a
+ * draw binds a whole block, which may pass the last segment end */
+static void createRing(GLuint capacity) {
+        GLsizeiptr size = (GLsizeiptr)RQ_FRAMES * capacity * _stride + RQ_BLOCK_BYTES;
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        _capacity = capacity;
+        glGenBuffers(1, &_ubo);
+        glBindBuffer(GL_UNIFORM_BUFFER, _ubo);
+        if (_persistent) {
+                glBufferStorage(GL_UNIFORM_BUFFER, size, NULL, flags);
+                _mapped = glMapBufferRange(GL_UNIFORM_BUFFER, 0, size, flags);
+        } else
+                glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_STREAM_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        memGLAlloc(MEM_BUFFER, _ubo, size);
+}
+
+static void destroyRing(void) {
+        GLuint i;
+        if (!_ubo)
+                return;
+        for (i = 0; i < RQ_FRAMES; ++i)
+                waitFence(i);
+        if (_mapped) {
+                glBindBuffer(GL_UNIFORM_BUFFER, _ubo);
+                glUnmapBuffer(GL_UNIFORM_BUFFER);
+                glBindBuffer(GL_UNIFORM_BUFFER, 0);
+                _mapped = NULL;
+        }
+        memGLFree(MEM_BUFFER, _ubo);
+        glDeleteBuffers(1, &_ubo);
+        _ubo = 0;
+}
+
+static int cmpItems(const void *a, const void *b) {
+        const item_t *ia = a, *ib = b;
+        if (ia->key != ib->key)
+                return ia->key < ib->key ? -1 : 1;
+        return (ia->order > ib->order) - (ia->order < ib->order);
+}
+
+/*!\brief applies the render states \a state, knowing that \a cur are
+ * the current ones. \return the number of GL calls issued. */
+static GLuint applyState(GLuint state, GLuint cur) {
+        GLuint n = 0;
+        if ((state ^ cur) & RQ_CULL) {
+                (state & RQ_CULL) ? glEnable(GL_CULL_FACE) : glDisable(GL_CULL_FACE);
+                ++n;
+        }
+        if ((state ^ cur) & RQ_DEPTH) {
+                (state & RQ_DEPTH) ? glEnable(GL_DEPTH_TEST) : glDisable(GL_DEPTH_TEST);
+                ++n;
+        }
+        return n;
+}
+
+/*!\brief counts the GL calls a toggle from \a cur to \a state costs */
+static GLuint countState(GLuint state, GLuint cur) {
+        return !!((state ^ cur) & RQ_CULL) + !!((state ^ cur) & RQ_DEPTH);
+}
+
+/*!\brief end of the draw starting at sorted item \a i : the end of its
+ * batch, at most RQ_INSTANCES items further. */
+static GLuint drawEnd(GLuint i) {
+        GLuint j = i + 1;
+        while (j < _nitems && j - i < RQ_INSTANCES && _items[j].key == _items[i].key)
+                ++j;
+        return j;
+}
+
+/*!\brief bytes taken in the ring by a draw of \a n objects, aligned so
+ * that the next one can be bound */
+static GLintptr drawBytes(GLuint n) {
+        GLintptr bytes = n * RQ_OBJECT_FLOATS * sizeof(GLfloat);
+        return (bytes + _align - 1) / _align * _align;
+}
+
+/*!\brief caches the uniform locations of \a pId, binds its "object"
+ * block to binding point 0 and creates the meshes and the uniform
+ * buffer ring. */
+void rqInit(GLuint pId) {
+        GLint align = 0;
+        _pId = pId;
+        glUniformBlockBinding(_pId, glGetUniformBlockIndex(_pId, "object"), 0);
+        glUseProgram(_pId);
+        glUniform1i(glGetUniformLocation(_pId, "tex"), 0);
+        glUseProgram(0);
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align);
+        _align = align < 1 ? 1 : align;
+        _stride = drawBytes(1);
+        _vao = meshCreate(&_vbo, &_ibo, _meshes);
+        _persistent = hasBufferStorage();
+        createRing(256);
+        /* as many items as the ring holds : the first frame does not
+         * allocate */
+        if ((_items = memMalloc(MEM_RENDER, _capacity * sizeof *_items)) != NULL)
+                _maxItems = _capacity;
+}
+
+/*!\brief takes the current "projectionMatrix" and "viewMatrix" as the
+ * camera of the next pushed items, then re-binds "modelMatrix". */
+void rqCamera(void) {
+        GLfloat p[16];
+        gl4duBindMatrix("projectionMatrix");
+        memcpy(p, gl4duGetMatrixData(), sizeof p);
+        gl4duBindMatrix("viewMatrix");
+        mult(_pv, p, gl4duGetMatrixData());
+        gl4duBindMatrix("modelMatrix");
+}
+
+/*!\brief copies the current camera (row-major projection * view) to
+ * \a pv. */
+void rqGetCamera(GLfloat *pv) {
+        memcpy(pv, _pv, sizeof _pv);
+}
+
+/*!\brief records the drawing of \a mesh (MESH_QUAD, MESH_CUBE or
+ * MESH_SPHERE) with the current "modelMatrix", texture \a tex and
+ * render states \a state (RQ_CULL, RQ_DEPTH) in layer \a layer. */
+void rqPush(GLuint layer, GLuint state, GLuint tex, GLuint mesh, GLfloat texRepeat,
+            GLint border) {
+        item_t *it;
+        GLuint max;
+        if (_nitems == _maxItems) {
+                max = _maxItems ? 2 * _maxItems : 256;
+                /* out of memory, the item is not drawn */
+                if ((it = memRealloc(MEM_RENDER, _items, max * sizeof *_items)) == NULL)
+                        return;
+                _items = it;
+                _maxItems = max;
+        }
+        it = &_items[_nitems];
+        it->order = _nitems++;
+        it->state = state;
+        it->tex = tex;
+        it->mesh = mesh;
+        it->key = ((unsigned long long)layer << 60) |
+                  ((unsigned long long)(state & 0xF) << 56) |
+                  ((unsigned long long)(tex & 0xFFFFFF) << 32) | mesh;
+        gl4duBindMatrix("modelMatrix");
+        mult(it->data, _pv, gl4duGetMatrixData());
+        it->data[16] = texRepeat;
+        it->data[17] = (GLfloat)border;
+        it->data[18] = it->data[19] = 0.0f;
+}
+
+/*!\brief sorts, uploads and submits the recorded items, then empties
+ * the queue. Leaves face culling and depth testing enabled. */
+void rqFlush(void) {
+        GLuint i, j, k, seg, state, tex, nstate, ntex;
+        GLintptr base, off;
+        GLubyte *dst;
+        const mesh_t *m;
+        memset(&_stats, 0, sizeof _stats);
+        _stats.persistent = _persistent;
+        _stats.items = _nitems;
+        /* what the unsorted submission would have cost */
+        nstate = RQ_CULL | RQ_DEPTH;
+        ntex = 0;
+        for (i = 0; i < _nitems; ++i) {
+                _stats.naiveStateChanges += countState(_items[i].state, nstate);
+                _stats.naiveStateChanges += _items[i].tex != ntex;
+                nstate = _items[i].state;
+                ntex = _items[i].tex;
+        }
+        if (!_nitems)
+                return;
+        qsort(_items, _nitems, sizeof *_items, cmpItems);
+        if (_nitems > _capacity) {
+                GLuint capacity = _capacity;
+                while (capacity < _nitems)
+                        capacity *= 2;
+                destroyRing();
+                createRing(capacity);
+        }
+        seg = _frame % RQ_FRAMES;
+        base = (GLintptr)seg * _capacity * _stride;
+        waitFence(seg);
+        glBindBuffer(GL_UNIFORM_BUFFER, _ubo);
+        ++_stats.calls;
+        /* the draws take at most _stride bytes per object */
+        if (_persistent)
+                dst = _mapped + base;
+        else {
+                dst = glMapBufferRange(GL_UNIFORM_BUFFER, base, (GLsizeiptr)_nitems * _stride,
+                                       GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+                                               GL_MAP_UNSYNCHRONIZED_BIT);
+                _stats.calls += 2;
+        }
+        for (i = 0, off = 0; i < _nitems; i = j) {
+                j = drawEnd(i);
+                for (k = i; k < j; ++k)
+                        memcpy(dst + off + (k - i) * sizeof _items[k].data, _items[k].data,
+                               sizeof _items[k].data);
+                off += drawBytes(j - i);
+        }
+        if (!_persistent)
+                glUnmapBuffer(GL_UNIFORM_BUFFER);
+        glUseProgram(_pId);
+        glActiveTexture(GL_TEXTURE0);
+        glBindVertexArray(_vao);
+        _stats.calls += 3;
+        state = RQ_CULL | RQ_DEPTH;
+        tex = 0;
+        for (i = 0, off = 0; i < _nitems; i = j) {
+                j = drawEnd(i);
+                if (!i || _items[i].key != _items[i - 1].key)
+                        ++_stats.batches;
+                if (_items[i].state != state) {
+                        _stats.stateChanges += applyState(_items[i].state, state);
+                        state = _items[i].state;
+                }
+                if (_items[i].tex != tex) {
+                        glBindTexture(GL_TEXTURE_2D, tex = _items[i].tex);
+                        ++_stats.stateChanges;
+                }
+                glBindBufferRange(GL_UNIFORM_BUFFER, 0, _ubo, base + off, RQ_BLOCK_BYTES);
+                m = &_meshes[_items[i].mesh];
+                glDrawElementsInstancedBaseVertex(
+                        GL_TRIANGLES, m->count, GL_UNSIGNED_INT,
+                        (const void *)(m->firstIndex * sizeof(GLuint)), j - i, m->baseVertex);
+                off += drawBytes(j - i);
+                ++_stats.draws;
+        }
+        glBindVertexArray(0);
+        _stats.calls += _stats.stateChanges + 2 * _stats.draws + 1;
+        _stats.calls += applyState(RQ_CULL | RQ_DEPTH, state);
+        _fences[seg] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        ++_stats.calls;
+        ++_frame;
+        _nitems = 0;
+}
+
+/*!\brief gets the counters of the last flushed frame. */
+void rqStats(rqstats_t *stats) {
+        *stats = _stats;
+}
+
+void rqClean(void) {
+        destroyRing();
+        meshDelete(&_vao, &_vbo, &_ibo);
+        memFree(_items);
+        _items = NULL;
+        _nitems = _maxItems = 0;
+}
@@ -0,0 +1,37 @@
+/*!\file renderqueue.h
+ *
+ * \brief Sorted render command queue with per-object data stored in a
+ * fenced uniform buffer ring.
+ */
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+#include <GL4D/gl4du.h>
+
+/*!\brief render states of an item */
+enum rqstate_t { RQ_CULL = 1, RQ_DEPTH = 2 };
+/*!\brief layers, drawn in that order */
+enum rqlayer_t { RQ_SCENE = 0, RQ_OVERLAY };
+
+/*!\brief counters of the last submitted frame : batches are runs of
+ * equal keys, each drawn by one or more instanced draws ; calls are
+ * the GL calls rqFlush issued. naiveStateChanges is what an unsorted
+ * submission (the former draw code) would have issued for the same
+ * items, which also made one draw per item. */
+typedef struct rqstats_t rqstats_t;
+struct rqstats_t {
+        GLuint items, batches, draws;
+        GLuint stateChanges, naiveStateChanges;
+        GLuint calls;
+        GLboolean persistent;
+};
+
+void rqInit(GLuint pId);
+void rqCamera(void);
+void rqGetCamera(GLfloat *pv);
+void rqPush(GLuint layer, GLuint state, GLuint tex, GLuint mesh, GLfloat texRepeat,
+            GLint border);
+void rqFlush(void);
+void rqStats(rqstats_t *stats);
+void rqClean(void);
+
+#endif
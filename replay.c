@@ -0,0 +1,165 @@
+/*!\file replay.c
+ *
+ * \brief Session recording and replay.
+ *
+ * A record file starts with a small header (magic, version, seed and
+ * labyrinth side) followed by the per-tick key states, run-length
+ * encoded : each entry is one key mask byte followed by the number of
+ * consecutive ticks it was held, written as a LEB128 varint.
+ */
+#include "replay.h"
+#include <stdio.h>
+
+#define REPLAY_MAGIC "GLMZ"
+#define REPLAY_VERSION 1
+
+/*!\brief file being recorded */
+static FILE *_recFile = NULL;
+/*!\brief key mask of the current run and its length in ticks */
+static unsigned char _recKeys = 0;
+static unsigned long _recRun = 0;
+
+/*!\brief file being replayed */
+static FILE *_playFile = NULL;
+/*!\brief key mask of the current run and the ticks left in it */
+static unsigned char _playKeys = 0;
+static unsigned long _playRun = 0;
+
+static void writeU32(FILE *f, unsigned int v) {
+        int i;
+        for (i = 0; i < 4; ++i)
+                fputc((v >> (8 * i)) & 0xFF, f);
+}
+
+static int readU32(FILE *f, unsigned int *v) {
+        int i, c;
+        *v = 0;
+        for (i = 0; i < 4; ++i) {
+                if ((c = fgetc(f)) == EOF)
+                        return -1;
+                *v |= (unsigned int)c << (8 * i);
+        }
+        return 0;
+}
+
+static void writeVarint(FILE *f, unsigned long v) {
+        while (v >= 0x80) {
+                fputc((v & 0x7F) | 0x80, f);
+                v >>= 7;
+        }
+        fputc(v, f);
+}
+
+static int readVarint(FILE *f, unsigned long *v) {
+        int c, shift = 0;
+        *v = 0;
+        do {
+                if ((c = fgetc(f)) == EOF || shift >= (int)(8 * sizeof *v))
+                        return -1;
+                *v |= (unsigned long)(c & 0x7F) << shift;
+                shift += 7;
+        } while (c & 0x80);
+        return 0;
+}
+
+static void flushRun(void) {
+        if (!_recRun)
+                return;
+        fputc(_recKeys, _recFile);
+        writeVarint(_recFile, _recRun);
+        _recRun = 0;
+}
+
+/*!\brief opens \a filename for recording and writes the header.
+ * \return 0 on success, -1 otherwise. */
+int recordOpen(const char *filename, unsigned int seed, unsigned int side) {
+        if ((_recFile = fopen(filename, "wb")) == NULL) {
+                fprintf(stderr, "can't open file %s for recording\n", filename);
+                return -1;
+        }
+        fwrite(REPLAY_MAGIC, 1, 4, _recFile);
+        fputc(REPLAY_VERSION, _recFile);
+        writeU32(_recFile, seed);
+        writeU32(_recFile, side);
+        _recKeys = 0;
+        _recRun = 0;
+        return 0;
+}
+
+/*!\brief records the key mask used by one simulation tick. */
+void recordTick(unsigned char keys) {
+        if (!_recFile)
+                return;
+        if (keys != _recKeys) {
+                flushRun();
+                _recKeys = keys;
+        }
+        ++_recRun;
+}
+
+/*!\brief flushes the pending run and closes the record file. */
+void recordClose(void) {
+        if (!_recFile)
+                return;
+        flushRun();
+        fclose(_recFile);
+        _recFile = NULL;
+}
+
+/*!\brief opens \a filename for replay and reads its header.
+ * \return 0 on success, -1 otherwise. */
+int replayOpen(const char *filename, unsigned int *seed, unsigned int *side) {
+        char magic[4];
+        if ((_playFile = fopen(filename, "rb")) == NULL) {
+                fprintf(stderr, "can't open file %s for replay\n", filename);
+                return -1;
+        }
+        if (fread(magic, 1, 4, _playFile) != 4 || magic[0] != REPLAY_MAGIC[0] ||
+            magic[1] != REPLAY_MAGIC[1] || magic[2] != REPLAY_MAGIC[2] ||
+            magic[3] != REPLAY_MAGIC[3] || fgetc(_playFile) != REPLAY_VERSION ||
+            readU32(_playFile, seed) < 0 || readU32(_playFile, side) < 0) {
+                fprintf(stderr, "%s is not a valid record file\n", filename);
+                replayClose();
+                return -1;
+        }
+        /* labyrinth() needs an odd side */
+        if (*side < 3 || *side > REPLAY_MAX_SIDE || !(*side & 1)) {
+                fprintf(stderr, "%s: invalid labyrinth side %u\n", filename, *side);
+                replayClose();
+                return -1;
+        }
+        _playRun = 0;
+        return 0;
+}
+
+/*!\brief gets the key mask of the next recorded tick.
+ * \return 1 if a tick was read, 0 at the end of the record, -1 if the
+ * record is truncated, corrupt or can't be read. */
+int replayTick(unsigned char *keys) {
+        int c;
+        if (!_playFile)
+                return 0;
+        while (!_playRun) {
+                if ((c = fgetc(_playFile)) == EOF) {
+                        if (!ferror(_playFile))
+                                return 0;
+                        fprintf(stderr, "can't read the record file\n");
+                        return -1;
+                }
+                if (readVarint(_playFile, &_playRun) < 0) {
+                        fprintf(stderr, "record file truncated or corrupt\n");
+                        return -1;
+                }
+                _playKeys = c;
+        }
+        --_playRun;
+        *keys = _playKeys;
+        return 1;
+}
+
+void replayClose(void) {
+        if (!_playFile)
+                return;
+        fclose(_playFile);
+        _playFile = NULL;
+}
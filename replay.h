@@ -0,0 +1,22 @@
+/*!\file replay.h
+ *
+ * \brief Session recording and replay (seed + per-tick key states).
+ */
+#ifndef REPLAY_H
+#define REPLAY_H
+
+/*!\brief bit of a tick key mask telling that the next level starts at
+ * this tick (the low bits are the direction keys) */
+#define REPLAY_NEXT_LEVEL 0x80
+/*!\brief largest labyrinth side a record may hold (sides are odd) */
+#define REPLAY_MAX_SIDE 4095
+
+int recordOpen(const char *filename, unsigned int seed, unsigned int side);
+void recordTick(unsigned char keys);
+void recordClose(void);
+
+int replayOpen(const char *filename, unsigned int *seed, unsigned int *side);
+int replayTick(unsigned char *keys);
+void replayClose(void);
+
+#endif
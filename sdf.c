@@ -0,0 +1,232 @@
+/*!\file sdf.c
+ *
+ * \brief Signed distance field of the labyrinth walls.
+ *
+ * Walls are sampled on a grid of res nodes per cell. The exact
+ * euclidean distance transform of Felzenszwalb and Huttenlocher is run
+ * twice, to the nearest wall node and to the nearest floor node ; it
+ * is separable, so rows then columns are split over threads. Nodes on
+ * a wall border count as wall, thus the inner distance is shifted by
+ * one node spacing.
+ *
+ * A lookup is one bilinear interpolation of four nodes, whose
+ * analytic derivatives give the gradient (the wall normal).
+ */
+#include "sdf.h"
+#include "memtrack.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WALL ((unsigned int)-1)
+#define EDT_INF 1e20f
+
+typedef struct pass_t pass_t;
+struct pass_t {
+        float *g;
+        int n, stride, step, from, to;
+        /*!\brief set if the scratch arrays could not be allocated */
+        int failed;
+};
+
+/*!\brief 1D squared distance transform of \a f (n samples) into \a d,
+ * \a v and \a z are scratch arrays of n and n + 1 elements. */
+static void edt1d(const float *f, int n, float *d, int *v, float *z) {
+        int k = 0, q;
+        double s;
+        v[0] = 0;
+        z[0] = -EDT_INF;
+        z[1] = EDT_INF;
+        for (q = 1; q < n; ++q) {
+                do {
+                        s = (((double)f[q] + q * q) - ((double)f[v[k]] + v[k] * v[k])) /
+                            (2.0 * (q - v[k]));
+                } while (s <= z[k] && k-- > 0);
+                ++k;
+                v[k] = q;
+                z[k] = s;
+                z[k + 1] = EDT_INF;
+        }
+        for (k = 0, q = 0; q < n; ++q) {
+                while (z[k + 1] < q)
+                        ++k;
+                d[q] = (q - v[k]) * (q - v[k]) + f[v[k]];
+        }
+}
+
+/*!\brief transforms the lines [from, to) of the grid ; a line starts
+ * at line * stride and its samples are step apart. */
+static void *passThread(void *arg) {
+        pass_t *p = arg;
+        float *f = memMalloc(MEM_SDF, p->n * sizeof *f), *d = memMalloc(MEM_SDF, p->n * sizeof *d);
+        float *z = memMalloc(MEM_SDF, (p->n + 1) * sizeof *z);
+        int *v = memMalloc(MEM_SDF, p->n * sizeof *v), l, i;
+        p->failed = !f || !d || !z || !v;
+        for (l = p->from; l < p->to && !p->failed; ++l) {
+                float *line = p->g + (size_t)l * p->stride;
+                for (i = 0; i < p->n; ++i)
+                        f[i] = line[(size_t)i * p->step];
+                edt1d(f, p->n, d, v, z);
+                for (i = 0; i < p->n; ++i)
+                        line[(size_t)i * p->step] = d[i];
+        }
+        memFree(f);
+        memFree(d);
+        memFree(z);
+        memFree(v);
+        return NULL;
+}
+
+/*!\brief 2D squared distance transform of the n x n grid \a g, where
+ * features are 0 and other nodes EDT_INF.
+ * \return 0 on success, -1 if out of memory or a thread can't be
+ * created. */
+static int edt2d(float *g, int n, int nthreads) {
+        pthread_t *th = memMalloc(MEM_SDF, nthreads * sizeof *th);
+        pass_t *p = memMalloc(MEM_SDF, nthreads * sizeof *p);
+        int t, started, axis, ret = 0;
+        if (!th || !p) {
+                memFree(th);
+                memFree(p);
+                return -1;
+        }
+        for (axis = 0; axis < 2 && !ret; ++axis) {
+                for (t = 0; t < nthreads; ++t) {
+                        p[t].g = g;
+                        p[t].n = n;
+                        /* rows first, then columns */
+                        p[t].stride = axis ? 1 : n;
+                        p[t].step = axis ? n : 1;
+                        p[t].from = (long long)n * t / nthreads;
+                        p[t].to = (long long)n * (t + 1) / nthreads;
+                        if (pthread_create(&th[t], NULL, passThread, &p[t])) {
+                                ret = -1;
+                                break;
+                        }
+                }
+                /* the started threads are always joined */
+                for (started = t, t = 0; t < started; ++t) {
+                        pthread_join(th[t], NULL);
+                        if (p[t].failed)
+                                ret = -1;
+                }
+        }
+        memFree(th);
+        memFree(p);
+        return ret;
+}
+
+/*!\brief tells if node (u, v) lies in a wall cell (borders included) */
+static int inWall(const unsigned int *lab, int side, int res, int u, int v) {
+        int i0 = (u - 1) / res, i1 = u / res, j0 = (v - 1) / res, j1 = v / res;
+        int a, b, i, j;
+        if (u % res)
+                i0 = i1;
+        if (v % res)
+                j0 = j1;
+        for (b = 0; b < 2; ++b)
+                for (a = 0; a < 2; ++a) {
+                        i = a ? i1 : i0;
+                        j = b ? j1 : j0;
+                        if (i >= 0 && j >= 0 && i < side && j < side && lab[j * side + i] == WALL)
+                                return 1;
+                }
+        return 0;
+}
+
+/*!\brief builds the field of labyrinth \a lab (side \a side, walls are
+ * -1, spanning [-planeScale, planeScale] as drawn by window.c) with \a
+ * res nodes per cell, using \a nthreads threads.
+ * \return 0 on success, -1 otherwise. */
+int sdfBuild(sdf_t *sdf, const unsigned int *lab, int side, float planeScale, int res,
+             int nthreads) {
+        int n = side * res + 1, u, v;
+        size_t k, nn = (size_t)n * n;
+        float *out, *in, d;
+        unsigned char *wall;
+        memset(sdf, 0, sizeof *sdf);
+        if (nthreads < 1)
+                nthreads = 1;
+        out = memMalloc(MEM_SDF, nn * sizeof *out);
+        in = memMalloc(MEM_SDF, nn * sizeof *in);
+        wall = memMalloc(MEM_SDF, nn);
+        sdf->d = memMalloc(MEM_SDF, nn * sizeof *sdf->d);
+        if (!out || !in || !wall || !sdf->d) {
+                memFree(out);
+                memFree(in);
+                memFree(wall);
+                sdfFree(sdf);
+                return -1;
+        }
+        for (v = 0; v < n; ++v)
+                for (u = 0; u < n; ++u) {
+                        k = (size_t)v * n + u;
+                        wall[k] = inWall(lab, side, res, u, v);
+                        out[k] = wall[k] ? 0.0f : EDT_INF;
+                        in[k] = wall[k] ? EDT_INF : 0.0f;
+                }
+        if (edt2d(out, n, nthreads) < 0 || edt2d(in, n, nthreads) < 0) {
+                memFree(out);
+                memFree(in);
+                memFree(wall);
+                sdfFree(sdf);
+                return -1;
+        }
+        sdf->n = n;
+        sdf->h = 2.0f * planeScale / (side * res);
+        sdf->x0 = -planeScale;
+        sdf->z0 = planeScale;
+        /* 64 steps per node spacing */
+        sdf->q = sdf->h / 64.0f;
+        for (k = 0; k < nn; ++k) {
+                d = wall[k] ? -(sqrtf(in[k]) - 1.0f) : sqrtf(out[k]);
+                d = d * 64.0f;
+                sdf->d[k] = d > 32767.0f ? 32767 : d < -32767.0f ? -32767 : (short)lrintf(d);
+        }
+        memFree(out);
+        memFree(in);
+        memFree(wall);
+        return 0;
+}
+
+/*!\brief distance from (\a x, \a z) to the nearest wall, sets the
+ * gradient (\a gx, \a gz) ; positions outside the grid are clamped. */
+float sdfSample(const sdf_t *sdf, float x, float z, float *gx, float *gz) {
+        float u = (x - sdf->x0) / sdf->h, v = (sdf->z0 - z) / sdf->h, fu, fv;
+        float d00, d10, d01, d11;
+        int i, j;
+        const short *p;
+        u = fminf(fmaxf(u, 0.0f), sdf->n - 1.001f);
+        v = fminf(fmaxf(v, 0.0f), sdf->n - 1.001f);
+        i = (int)u;
+        j = (int)v;
+        fu = u - i;
+        fv = v - j;
+        p = sdf->d + (size_t)j * sdf->n + i;
+        d00 = p[0];
+        d10 = p[1];
+        d01 = p[sdf->n];
+        d11 = p[sdf->n + 1];
+        /* v grows toward -z */
+        *gx = ((1.0f - fv) * (d10 - d00) + fv * (d11 - d01)) * sdf->q / sdf->h;
+        *gz = -((1.0f - fu) * (d01 - d00) + fu * (d11 - d10)) * sdf->q / sdf->h;
+        return ((1.0f - fv) * ((1.0f - fu) * d00 + fu * d10) +
+                fv * ((1.0f - fu) * d01 + fu * d11)) *
+               sdf->q;
+}
+
+/*!\brief pushes the circle of center (\a x, \a z) and radius \a
+ * radius out of the walls along their normal ; the tangential part of
+ * the move is kept, which makes it slide along walls. */
+void sdfCollide(const sdf_t *sdf, float *x, float *z, float radius) {
+        float gx, gz, d = sdfSample(sdf, *x, *z, &gx, &gz);
+        float pen = fmaxf(radius - d, 0.0f) / (sqrtf(gx * gx + gz * gz) + 1e-6f);
+        *x += gx * pen;
+        *z += gz * pen;
+}
+
+void sdfFree(sdf_t *sdf) {
+        memFree(sdf->d);
+        memset(sdf, 0, sizeof *sdf);
+}
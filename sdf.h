@@ -0,0 +1,25 @@
+/*!\file sdf.h
+ *
+ * \brief Signed distance field of the labyrinth walls, used for
+ * collisions and sliding.
+ */
+#ifndef SDF_H
+#define SDF_H
+
+/*!\brief distances sampled on a regular grid of n x n nodes covering
+ * the labyrinth, quantized on 16 bits (negative inside walls). */
+typedef struct sdf_t sdf_t;
+struct sdf_t {
+        int n;
+        /*!\brief world position of node (0, 0), node spacing and quantum */
+        float x0, z0, h, q;
+        short *d;
+};
+
+int sdfBuild(sdf_t *sdf, const unsigned int *lab, int side, float planeScale, int res,
+             int nthreads);
+float sdfSample(const sdf_t *sdf, float x, float z, float *gx, float *gz);
+void sdfCollide(const sdf_t *sdf, float *x, float *z, float radius);
+void sdfFree(sdf_t *sdf);
+
+#endif
@@ -1,12 +1,12 @@
 #version 330
 uniform sampler2D tex;
-uniform int border;
 
 in  vec2 vsoTexCoord;
+flat in int vsoBorder;
 out vec4 fragColor;
 
 void main(void) {
-  if( border != 0 && (vsoTexCoord.s < 0.02 ||
+  if( vsoBorder != 0 && (vsoTexCoord.s < 0.02 ||
 		      vsoTexCoord.t < 0.02 ||
 		      (1 - vsoTexCoord.s) < 0.02 || 
 		      (1 - vsoTexCoord.t) < 0.02 ) )
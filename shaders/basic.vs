@@ -1,16 +1,24 @@
 #version 330
 
-uniform mat4 modelMatrix;
-uniform mat4 viewMatrix;
-uniform mat4 projectionMatrix;
-uniform float texRepeat;
+struct object_t {
+  mat4 mvpMatrix;
+  /* x = texRepeat, y = border */
+  vec4 params;
+};
+/* the objects of one instanced draw, RQ_INSTANCES in renderqueue.c */
+layout (std140, row_major) uniform object {
+  object_t objects[204];
+};
 layout (location = 0) in vec3 vsiPosition;
 layout (location = 1) in vec3 vsiNormal;
 layout (location = 2) in vec2 vsiTexCoord;
  
 out vec2 vsoTexCoord;
+flat out int vsoBorder;
 
 void main(void) {
-  gl_Position = projectionMatrix * viewMatrix * modelMatrix * vec4(vsiPosition.xyz, 1.0);
-  vsoTexCoord = texRepeat * vsiTexCoord;
+  object_t o = objects[gl_InstanceID];
+  gl_Position = o.mvpMatrix * vec4(vsiPosition.xyz, 1.0);
+  vsoTexCoord = o.params.x * vsiTexCoord;
+  vsoBorder = int(o.params.y);
 }
@@ -0,0 +1,85 @@
+#version 430
+/* frustum and hierarchical-Z occlusion culling of the wall and ball
+ * instances ; survivors are appended to the visible list of their
+ * indirect draw command. Phase 1 keeps the instances visible last
+ * frame, phase 2 the other ones not occluded in the pyramid built from
+ * phase 1, and records which are visible for the next frame */
+layout (local_size_x = 64) in;
+
+struct instance_t {
+  vec4 pos;   /* xyz = center, w = type (command index) */
+  vec4 scale; /* xyz = half extents */
+};
+struct command_t {
+  uint count, instanceCount, firstIndex;
+  int  baseVertex;
+  uint baseInstance;
+};
+
+layout (std430, binding = 0) readonly buffer instances { instance_t inst[]; };
+layout (std430, binding = 1) writeonly buffer visibles { uint visible[]; };
+layout (std430, binding = 2) buffer commands { command_t cmd[]; };
+layout (std430, binding = 3) buffer flags { uint visibleLast[]; };
+
+uniform mat4 viewProjection;
+uniform vec4 planes[6];
+uniform uint ninstances;
+uniform sampler2D hiz;
+uniform int hizLevels;
+/* part of the pyramid level 0 covered by the scene (the bottom left one) */
+uniform ivec2 hizSize;
+uniform int phase;
+
+/* tells if the bounding box of the sphere (c, r) is behind the
+ * farthest depth drawn by phase 1 over its screen footprint */
+bool occluded(vec3 c, float r) {
+  vec3 lo = vec3(1.0), hi = vec3(0.0);
+  for(int k = 0; k < 8; ++k) {
+    vec3 p = c + r * vec3((k & 1) != 0 ? 1.0 : -1.0,
+			  (k & 2) != 0 ? 1.0 : -1.0,
+			  (k & 4) != 0 ? 1.0 : -1.0);
+    vec4 q = viewProjection * vec4(p, 1.0);
+    /* crosses the camera plane */
+    if(q.w <= 0.0)
+      return false;
+    vec3 n = q.xyz / q.w * 0.5 + 0.5;
+    lo = min(lo, n);
+    hi = max(hi, n);
+  }
+  lo.xy = clamp(lo.xy, 0.0, 1.0);
+  hi.xy = clamp(hi.xy, 0.0, 1.0);
+  vec2 size = (hi.xy - lo.xy) * vec2(hizSize);
+  int level = clamp(int(ceil(log2(max(max(size.x, size.y), 1.0)))), 0, hizLevels - 1);
+  /* texels of the footprint corners ; the last texel of an odd level
+   * also covers the remaining pixels */
+  ivec2 last = max(hizSize >> level, ivec2(1)) - 1;
+  ivec2 a = min((ivec2(lo.xy * vec2(hizSize)) >> level), last);
+  ivec2 b = min((ivec2(hi.xy * vec2(hizSize)) >> level), last);
+  float d = max(max(texelFetch(hiz, a, level).r, texelFetch(hiz, ivec2(b.x, a.y), level).r),
+		max(texelFetch(hiz, ivec2(a.x, b.y), level).r, texelFetch(hiz, b, level).r));
+  return lo.z > d;
+}
+
+void main(void) {
+  uint i = gl_GlobalInvocationID.x;
+  if(i >= ninstances)
+    return;
+  vec3 c = inst[i].pos.xyz;
+  float r = length(inst[i].scale.xyz);
+  bool inFrustum = true, drawn;
+  for(int k = 0; k < 6; ++k)
+    if(dot(planes[k].xyz, c) + planes[k].w < -r)
+      inFrustum = false;
+  drawn = inFrustum && visibleLast[i] != 0u;
+  if(phase == 1 && !drawn)
+    return;
+  if(phase == 2) {
+    bool v = inFrustum && !occluded(c, r);
+    visibleLast[i] = v ? 1u : 0u;
+    if(!v || drawn)
+      return;
+  }
+  uint t = uint(inst[i].pos.w) + (phase == 2 ? 2u : 0u);
+  uint slot = atomicAdd(cmd[t].instanceCount, 1u);
+  visible[cmd[t].baseInstance + slot] = i;
+}
@@ -0,0 +1,30 @@
+#version 430
+/* builds one level of the hierarchical-Z pyramid : copies the depth
+ * buffer (srcLevel < 0) or keeps the farthest depth of the matching
+ * texels of the previous level */
+layout (local_size_x = 8, local_size_y = 8) in;
+
+layout (r32f, binding = 0) writeonly uniform image2D dst;
+uniform sampler2D src;
+uniform int srcLevel;
+/* part of the source level covered by the scene (the bottom left one) */
+uniform ivec2 srcSize;
+
+void main(void) {
+  ivec2 p = ivec2(gl_GlobalInvocationID.xy), ss = srcSize;
+  ivec2 ds = srcLevel < 0 ? ss : max(ss / 2, ivec2(1));
+  if(p.x >= ds.x || p.y >= ds.y)
+    return;
+  if(srcLevel < 0) {
+    imageStore(dst, p, vec4(texelFetch(src, p, 0).r));
+    return;
+  }
+  /* odd sizes : the last texel also covers the remaining row/column */
+  ivec2 e = ivec2(p.x == ds.x - 1 && (ss.x & 1) != 0 ? 3 : 2,
+		  p.y == ds.y - 1 && (ss.y & 1) != 0 ? 3 : 2);
+  float m = 0.0;
+  for(int y = 0; y < e.y; ++y)
+    for(int x = 0; x < e.x; ++x)
+      m = max(m, texelFetch(src, min(2 * p + ivec2(x, y), ss - 1), srcLevel).r);
+  imageStore(dst, p, vec4(m));
+}
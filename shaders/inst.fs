@@ -0,0 +1,12 @@
+#version 430
+uniform sampler2D wallTex;
+uniform sampler2D ballTex;
+
+in  vec2 vsoTexCoord;
+flat in int vsoType;
+out vec4 fragColor;
+
+void main(void) {
+  vec4 w = texture(wallTex, vsoTexCoord), b = texture(ballTex, vsoTexCoord);
+  fragColor = vsoType == 0 ? w : b;
+}
@@ -0,0 +1,24 @@
+#version 430
+
+struct instance_t {
+  vec4 pos;   /* xyz = center, w = type */
+  vec4 scale; /* xyz = half extents */
+};
+layout (std430, binding = 0) readonly buffer instances { instance_t inst[]; };
+
+uniform mat4 viewProjection;
+layout (location = 0) in vec3 vsiPosition;
+layout (location = 1) in vec3 vsiNormal;
+layout (location = 2) in vec2 vsiTexCoord;
+/* index of the instance, from the visible list (per instance attribute) */
+layout (location = 3) in uint vsiInstance;
+
+out vec2 vsoTexCoord;
+flat out int vsoType;
+
+void main(void) {
+  instance_t it = inst[vsiInstance];
+  gl_Position = viewProjection * vec4(it.pos.xyz + it.scale.xyz * vsiPosition, 1.0);
+  vsoTexCoord = vsiTexCoord;
+  vsoType = int(it.pos.w);
+}
@@ -6,11 +6,22 @@
  * \date March 05 2018
  */
 #include "collision_toolbox.h"
-#include <GL4D/gl4dg.h>
+#include "dynres.h"
+#include "gpucull.h"
+#include "level.h"
+#include "memtrack.h"
+#include "mesh.h"
+#include "pickups.h"
+#include "pvs.h"
+#include "renderqueue.h"
+#include "sdf.h"
+#include "replay.h"
 #include <GL4D/gl4dp.h>
 #include <GL4D/gl4duw_SDL2.h>
 #include <SDL_image.h>
+#include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 struct _Cercle {
         GLfloat x, y, rayon;
@@ -33,14 +44,18 @@ static void keydown(int keycode);
 static void keyup(int keycode);
 static void pmotion(int x, int y);
 static void draw(void);
+static void initLevel(void);
+static void streamLevel(void);
+static void swapLevel(void);
+static void planeTexFilters(void);
+static void simulate(double dt);
+static int replay(const char *filename);
+static void initPVS(const char *filename);
 
 static void my_draw(void);
-int hit_mur(Cercle, Point);
+static void drawGPU(void);
 void hit_ball(Cercle);
 
-/* from makeLabyrinth.c */
-extern unsigned int *labyrinth(int w, int h);
-
 /*!\brief opened window width and height */
 static int _wW = 800, _wH = 600;
 /*!\brief mouse position (modified by pmotion function) */
@@ -49,10 +64,10 @@ static int _xm = 400, _ym = 300;
 static GLuint *_labyrinth = NULL;
 /*!\brief labyrinth side */
 static GLuint _lab_side = 15;
-/*!\brief Quad geometry Id  */
-static GLuint _plane = 0;
-/*!\brief Cube geometry Id  */
-static GLuint _cube = 0;
+/*!\brief seed used to generate the labyrinth and its balls */
+static GLuint _seed = 0;
+/*!\brief duration of one simulation tick (fixed time step, in seconds) */
+#define TICK (1.0 / 60.0)
 /*!\brief GLSL program Id */
 static GLuint _pId = 0;
 /*!\brief plane texture Id */
@@ -68,7 +83,6 @@ static GLboolean _mipmap = GL_FALSE;
 
 static GLuint _wallTexId = 0;
 static GLuint _ballTexId = 0;
-static GLuint _sphere = 0;
 
 /*!\brief enum that index keyboard mapping for direction commands */
 enum kyes_t { KLEFT = 0, KRIGHT, KUP, KDOWN };
@@ -87,17 +101,102 @@ struct cam_t {
 /*!\brief the used camera */
 static cam_t _cam = {0, 0, 0};
 
-int nb_ball = 0;
-GLfloat *balls;
+/*!\brief balls to collect */
+static pickups_t _balls;
+/*!\brief signed distance field of the walls, used for collisions */
+static sdf_t _wallsSdf;
+/*!\brief nodes per cell of _wallsSdf : at 8, a distance is at most
+ * 0.25 too long (next to wall corners) for a 1.5 player radius */
+#define SDF_RES 8
+
+/*!\brief potentially visible sets of the current level (empty if
+ * none) : baked by bakePVS for the first level, then by the worker for
+ * the next ones, for the radius of the first (_pvsRadius, 0 : none) */
+static pvs_t _pvs;
+static GLuint _pvsRadius = 0;
+/*!\brief cells visible from _pvsCell, the camera cell (-1 : draw all) */
+static GLubyte *_visible = NULL;
+static int _pvsCell = -1;
+
+/*!\brief GPU-driven culling and drawing of walls and balls : available
+ * (OpenGL 4.3), in use, and ball count last uploaded */
+static GLboolean _gpuCull = GL_FALSE, _gpuOn = GL_FALSE;
+static GLuint _gpuBalls = (GLuint)-1;
+
+/*!\brief dynamic resolution : in use and frame time budget (in
+ * milliseconds) */
+static GLboolean _dynres = GL_FALSE;
+static GLdouble _budget = 1000.0 / 60.0;
+
+/*!\brief index of the current level (0 for the first one) */
+static GLuint _levelNum = 0;
+/*!\brief states of the next level : not started, being generated on
+ * the worker thread, being uploaded, ready to be swapped in */
+enum next_t { NEXT_NONE = 0, NEXT_GEN, NEXT_UPLOAD, NEXT_READY };
+/*!\brief the next level, its state, its plane texture and the next
+ * texture row to upload */
+static level_t _next;
+static int _nextState = NEXT_NONE;
+static GLuint _nextTexId = 0;
+static GLuint _nextRow = 0;
+/*!\brief upload time allowed per frame (in milliseconds) and bytes per
+ * upload call */
+#define UPLOAD_BUDGET 2.0
+#define UPLOAD_BYTES (1 << 16)
+/*!\brief map cell marked as the camera position */
+static int _markX = -1, _markZ = -1;
 
 /*!\brief creates the window, initializes OpenGL parameters,
- * initializes data and maps callback functions */
+ * initializes data and maps callback functions.
+ *
+ * "--seed N" fixes the generation seed, "--record FILE" records the
+ * session, "--replay FILE" re-executes a recorded session headless,
+ * "--pvs FILE" uses the visible sets baked by bakePVS for this seed and
+ * "--budget MS" turns the dynamic resolution on with a frame time
+ * budget of MS milliseconds.
+ *
+ * The file of --pvs only holds the sets of the first level ; the next
+ * levels get theirs baked at runtime by the worker thread, for the
+ * same radius. The sets only select what the CPU path draws : with the
+ * GPU culling on (available with OpenGL 4.3, toggled by 'g'), --pvs has
+ * no effect.
+ */
 int main(int argc, char **argv) {
+        int i;
+        const char *recfile = NULL, *pvsfile = NULL;
+        _seed = time(NULL);
+        for (i = 1; i < argc; ++i) {
+                /* the other arguments are left to GL4Dummies */
+                if (strcmp(argv[i], "--seed") && strcmp(argv[i], "--record") &&
+                    strcmp(argv[i], "--pvs") && strcmp(argv[i], "--budget") &&
+                    strcmp(argv[i], "--replay"))
+                        continue;
+                if (i == argc - 1) {
+                        fprintf(stderr, "usage : %s [--seed N] [--record FILE] [--replay FILE] "
+                                "[--pvs FILE] [--budget MS]\n%s needs a value\n", argv[0],
+                                argv[i]);
+                        return 1;
+                }
+                if (!strcmp(argv[i], "--seed"))
+                        _seed = strtoul(argv[++i], NULL, 10);
+                else if (!strcmp(argv[i], "--record"))
+                        recfile = argv[++i];
+                else if (!strcmp(argv[i], "--pvs"))
+                        pvsfile = argv[++i];
+                else if (!strcmp(argv[i], "--budget"))
+                        _dynres = (_budget = strtod(argv[++i], NULL)) > 0.0;
+                else if (!strcmp(argv[i], "--replay"))
+                        return replay(argv[++i]);
+        }
+        if (recfile && recordOpen(recfile, _seed, _lab_side) < 0)
+                return 1;
         if (!gl4duwCreateWindow(argc, argv, "GL4Dummies", 10, 10, _wW, _wH,
                                 GL4DW_RESIZABLE | GL4DW_SHOWN))
                 return 1;
         initGL();
         initData();
+        if (pvsfile)
+                initPVS(pvsfile);
         atexit(quit);
         gl4duwResizeFunc(resize);
         gl4duwKeyUpFunc(keyup);
@@ -110,13 +209,13 @@ int main(int argc, char **argv) {
 }
 
 void show_info_balle() {
-        printf("Il reste %d balles.\n", nb_ball / 2);
-        /*int j, k = 0;
-           for(j = 0; j < nb_ball; j += 2) {
-                printf("Balle n%d ", ++k);
-                printf("\t(%.2f, %.2f)\n", balls[j], balls[j+ 1]);
+        printf("Il reste %d balles.\n", _balls.count);
+        /*int j;
+           for(j = 0; j < _balls.count; ++j) {
+                printf("Balle n%d ", j + 1);
+                printf("\t(%.2f, %.2f)\n", _balls.x[j], _balls.z[j]);
            }*/
-        if (nb_ball == 0) {
+        if (_balls.count == 0) {
                 printf("Bravo!\n");
         }
 }
@@ -139,43 +238,22 @@ static void initGL(void) {
         gl4duGenMatrix(GL_FLOAT, "modelMatrix");
         gl4duGenMatrix(GL_FLOAT, "viewMatrix");
         gl4duGenMatrix(GL_FLOAT, "projectionMatrix");
+        glCullFace(GL_BACK);
+        rqInit(_pId);
+        _gpuOn = _gpuCull = gpuInit();
+        drSetBudget(_dynres ? _budget : 0.0);
         resize(_wW, _wH);
 }
 
-void initBalls() {
-        int i, j;
-        GLfloat unit = (_planeScale * 2.0f) / _lab_side;
-        for (j = 0; j < _lab_side; j++) {
-                for (i = 0; i < _lab_side; i++) {
-                        if (_labyrinth[j * _lab_side + i] != -1) {
-                                srand(time(NULL) + i + j);
-                                if (rand() % 10 > 7) {
-                                        nb_ball += 2;
-                                        balls = realloc(balls, nb_ball * sizeof(float));
-                                        balls[nb_ball - 2] = (i * unit) - _planeScale + unit / 2;
-                                        balls[nb_ball - 1] = -((j * unit) - _planeScale + unit / 2);
-                                }
-                        }
-                }
-        }
-        show_info_balle();
-}
-
 /*!\brief initializes data :
  *
- * creates 3D objects (plane and sphere) and 2D textures.
+ * creates 2D textures (the meshes belong to the render queue, see
+ * mesh.c).
  */
 static void initData(void) {
         /* a red-white texture used to draw a compass */
         GLuint northsouth[] = {(255 << 24) + 255, -1};
         GLuint ball_color[1] = {RGB(255, 255, 0)};
-        /* generates a quad using GL4Dummies */
-        _plane = gl4dgGenQuadf();
-        /* generates a cube using GL4Dummies */
-        _cube = gl4dgGenCubef();
-
-        _sphere = gl4dgGenSpheref(5, 5);
-
         /* creation and parametrization of the plane texture */
         glGenTextures(1, &_planeTexId);
         glBindTexture(GL_TEXTURE_2D, _planeTexId);
@@ -183,9 +261,20 @@ static void initData(void) {
         glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        _labyrinth = labyrinth(_lab_side, _lab_side);
+        initLevel();
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, _lab_side, _lab_side, 0, GL_RGBA,
                      GL_UNSIGNED_BYTE, _labyrinth);
+        memGLAlloc(MEM_TEXTURE, _planeTexId, _lab_side * _lab_side * sizeof *_labyrinth);
+        /* the next level is uploaded in this one, then they are swapped */
+        glGenTextures(1, &_nextTexId);
+        glBindTexture(GL_TEXTURE_2D, _nextTexId);
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, _lab_side, _lab_side, 0, GL_RGBA,
+                     GL_UNSIGNED_BYTE, NULL);
+        memGLAlloc(MEM_TEXTURE, _nextTexId, _lab_side * _lab_side * sizeof *_labyrinth);
 
         /* creation and parametrization of the compass texture */
         glGenTextures(1, &_compassTexId);
@@ -196,6 +285,7 @@ static void initData(void) {
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 2, 0, GL_RGBA, GL_UNSIGNED_BYTE,
                      northsouth);
+        memGLAlloc(MEM_TEXTURE, _compassTexId, sizeof northsouth);
 
         SDL_Surface *t;
         glGenTextures(1, &_wallTexId);
@@ -210,11 +300,13 @@ static void initData(void) {
 #endif
                 glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, _planeScale, _planeScale, 0, mode,
                              GL_UNSIGNED_BYTE, t->pixels);
+                memGLAlloc(MEM_TEXTURE, _wallTexId, 4 * (size_t)_planeScale * _planeScale);
                 SDL_FreeSurface(t);
         } else {
                 fprintf(stderr, "can't open file images/wall.jpeg : %s\n", SDL_GetError());
                 glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE,
                              NULL);
+                memGLAlloc(MEM_TEXTURE, _wallTexId, 4);
         }
 
         glGenTextures(1, &_ballTexId);
@@ -225,10 +317,151 @@ static void initData(void) {
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE,
                      ball_color);
+        memGLAlloc(MEM_TEXTURE, _ballTexId, sizeof ball_color);
 
         glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+/*!\brief makes \a l the current level : its labyrinth, balls and
+ * field replace the current ones, the camera goes back to the center. */
+static void takeLevel(level_t *l) {
+        memFree(_labyrinth);
+        pickupsFree(&_balls);
+        sdfFree(&_wallsSdf);
+        _labyrinth = l->lab;
+        _balls = l->balls;
+        _wallsSdf = l->sdf;
+        /* the previous sets no longer apply */
+        pvsFree(&_pvs);
+        _pvs = l->pvs;
+        _pvsCell = -1;
+        if (_visible)
+                memset(_visible, 0, _lab_side * _lab_side * sizeof *_visible);
+        memFree(l->walls);
+        memset(l, 0, sizeof *l);
+        _cam.x = _cam.z = _cam.theta = 0.0f;
+        _markX = _markZ = -1;
+}
+
+/*!\brief generates the first level from _seed. Does not use OpenGL
+ * unless GPU culling is on, thus is also used by the headless
+ * replay. */
+static void initLevel(void) {
+        level_t l;
+        if (levelBuild(&l, levelSeed(_seed, _levelNum), _lab_side, _planeScale, SDF_RES, 0,
+                       sysconf(_SC_NPROCESSORS_ONLN)) < 0) {
+                fprintf(stderr, "can't generate the level\n");
+                exit(1);
+        }
+        if (_gpuCull) {
+                gpuStageWalls(l.walls, l.nwalls, _lab_side, _planeScale);
+                gpuStageBalls(l.balls.x, l.balls.z, l.balls.count, l.balls.capacity,
+                              (_planeScale / _lab_side) / 4);
+                while (!gpuStageStep(UPLOAD_BYTES))
+                        ;
+                gpuSwap();
+                _gpuBalls = l.balls.count;
+        }
+        takeLevel(&l);
+        show_info_balle();
+}
+
+/*!\brief generates the next level on the worker thread, then uploads
+ * it a part at a time, for at most UPLOAD_BUDGET milliseconds per
+ * call, so that no frame is delayed. */
+static void streamLevel(void) {
+        double t0 = gl4dGetElapsedTime();
+        GLuint rows;
+        switch (_nextState) {
+        case NEXT_NONE:
+                /* one core is left to the rendering */
+                if (levelBuildAsync(&_next, levelSeed(_seed, _levelNum + 1), _lab_side,
+                                    _planeScale, SDF_RES, _pvsRadius,
+                                    sysconf(_SC_NPROCESSORS_ONLN) - 1) == 0)
+                        _nextState = NEXT_GEN;
+                return;
+        case NEXT_GEN:
+                if (!levelReady())
+                        return;
+                if (levelWait() < 0) {
+                        _nextState = NEXT_NONE;
+                        return;
+                }
+                glBindTexture(GL_TEXTURE_2D, _nextTexId);
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, _lab_side, _lab_side, 0, GL_RGBA,
+                             GL_UNSIGNED_BYTE, NULL);
+                if (_gpuCull) {
+                        gpuStageWalls(_next.walls, _next.nwalls, _lab_side, _planeScale);
+                        gpuStageBalls(_next.balls.x, _next.balls.z, _next.balls.count,
+                                      _next.balls.capacity, (_planeScale / _lab_side) / 4);
+                }
+                _nextRow = 0;
+                _nextState = NEXT_UPLOAD;
+                /* fall through */
+        case NEXT_UPLOAD:
+                glBindTexture(GL_TEXTURE_2D, _nextTexId);
+                do {
+                        if (_nextRow < _lab_side) {
+                                rows = UPLOAD_BYTES / (_lab_side * sizeof *_next.lab) + 1;
+                                if (rows > _lab_side - _nextRow)
+                                        rows = _lab_side - _nextRow;
+                                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, _nextRow, _lab_side, rows,
+                                                GL_RGBA, GL_UNSIGNED_BYTE,
+                                                _next.lab + _nextRow * _lab_side);
+                                _nextRow += rows;
+                        } else if (!_gpuCull || gpuStageStep(UPLOAD_BYTES)) {
+                                _nextState = NEXT_READY;
+                                break;
+                        }
+                } while (gl4dGetElapsedTime() - t0 < UPLOAD_BUDGET);
+                glBindTexture(GL_TEXTURE_2D, 0);
+                return;
+        default:
+                return;
+        }
+}
+
+/*!\brief swaps in the next level, generated and uploaded beforehand.
+ * Headless (replay), only its CPU side is swapped. */
+static void swapLevel(void) {
+        char name[32];
+        GLuint t;
+        ++_levelNum;
+        if (_planeTexId) {
+                t = _planeTexId;
+                _planeTexId = _nextTexId;
+                _nextTexId = t;
+                planeTexFilters();
+        }
+        if (_gpuCull) {
+                gpuSwap();
+                _gpuBalls = _next.balls.count;
+        }
+        takeLevel(&_next);
+        _nextState = NEXT_NONE;
+        printf("Niveau %u.\n", _levelNum + 1);
+        show_info_balle();
+        /* every level costs the same (see memCheckpoint for the visible
+         * sets), a growth is a leak */
+        snprintf(name, sizeof name, "level %u", _levelNum + 1);
+        memCheckpoint(name);
+}
 
-        initBalls();
+/*!\brief loads the visible sets of \a filename if they were baked for
+ * the current labyrinth, ignores them otherwise. */
+static void initPVS(const char *filename) {
+        if (pvsLoad(&_pvs, filename, _lab_side) < 0)
+                return;
+        if (_pvs.seed != _seed) {
+                fprintf(stderr, "%s was baked for seed %u, ignored\n", filename, _pvs.seed);
+                pvsFree(&_pvs);
+                return;
+        }
+        if ((_visible = memCalloc(MEM_PVS, _lab_side * _lab_side, sizeof *_visible)) == NULL) {
+                pvsFree(&_pvs);
+                return;
+        }
+        _pvsRadius = _pvs.radius;
 }
 
 /*!\brief function called by GL4Dummies' loop at resize. Sets the
@@ -241,6 +474,9 @@ static void resize(int w, int h) {
         _wW = w;
         _wH = h;
         glViewport(0, 0, _wW, _wH);
+        if (_gpuCull)
+                gpuResize(_wW, _wH);
+        drResize(_wW, _wH);
         gl4duBindMatrix("projectionMatrix");
         gl4duLoadIdentityf();
         gl4duFrustumf(-0.5, 0.5, -0.5 * _wH / _wW, 0.5 * _wH / _wW, 1.0,
@@ -252,7 +488,6 @@ static void resize(int w, int h) {
  */
 static void updatePosition(void) {
         GLfloat xf, zf;
-        static int xi = -1, zi = -1;
         /* translate to lower-left */
         xf = _cam.x + _planeScale;
         zf = -_cam.z + _planeScale;
@@ -263,50 +498,88 @@ static void updatePosition(void) {
         xf = xf * _lab_side;
         zf = zf * _lab_side;
         /* re-set previous position to black and the new one to red */
-        if ((int)xf != xi || (int)zf != zi) {
-                if (xi >= 0 && xi < _lab_side && zi >= 0 && zi < _lab_side &&
-                    _labyrinth[zi * _lab_side + xi] != -1) {
-                        _labyrinth[zi * _lab_side + xi] = 0;
-                        glBindTexture(GL_TEXTURE_2D, _planeTexId);
-                        /* try to use the glTexSubImage2D function instead of the glTexImage2D
-                         * function */
-                        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, _lab_side, _lab_side, 0, GL_RGBA,
-                                     GL_UNSIGNED_BYTE, _labyrinth);
-                }
-                xi = (int)xf;
-                zi = (int)zf;
-                if (xi >= 0 && xi < _lab_side && zi >= 0 && zi < _lab_side &&
-                    _labyrinth[zi * _lab_side + xi] != -1) {
-                        _labyrinth[zi * _lab_side + xi] = RGB(255, 0, 0);
-                        glBindTexture(GL_TEXTURE_2D, _planeTexId);
-                        /* try to use the glTexSubImage2D function instead of the glTexImage2D
-                         * function */
-                        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, _lab_side, _lab_side, 0, GL_RGBA,
-                                     GL_UNSIGNED_BYTE, _labyrinth);
-                }
+        if ((int)xf != _markX || (int)zf != _markZ) {
+                if (_markX >= 0 && _markX < _lab_side && _markZ >= 0 && _markZ < _lab_side &&
+                    _labyrinth[_markZ * _lab_side + _markX] != -1)
+                        _labyrinth[_markZ * _lab_side + _markX] = 0;
+                _markX = (int)xf;
+                _markZ = (int)zf;
+                if (_markX >= 0 && _markX < _lab_side && _markZ >= 0 && _markZ < _lab_side &&
+                    _labyrinth[_markZ * _lab_side + _markX] != -1)
+                        _labyrinth[_markZ * _lab_side + _markX] = RGB(255, 0, 0);
+                /* no texture to update when replaying headless */
+                if (!_planeTexId)
+                        return;
+                glBindTexture(GL_TEXTURE_2D, _planeTexId);
+                /* try to use the glTexSubImage2D function instead of the glTexImage2D
+                 * function */
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, _lab_side, _lab_side, 0, GL_RGBA,
+                             GL_UNSIGNED_BYTE, _labyrinth);
         }
 }
 
+/*!\brief packs the virtual keyboard states in a bit mask */
+static unsigned char getKeys(void) {
+        int i;
+        unsigned char keys = 0;
+        for (i = 0; i < 4; ++i)
+                if (_keys[i])
+                        keys |= 1 << i;
+        return keys;
+}
+
+/*!\brief unpacks a bit mask into the virtual keyboard states */
+static void setKeys(unsigned char keys) {
+        int i;
+        for (i = 0; i < 4; ++i)
+                _keys[i] = (keys >> i) & 1;
+}
+
 /*!\brief function called by GL4Dummies' loop at idle.
+ *
+ * runs as many fixed simulation ticks as the elapsed time allows so
+ * that a recorded session can be replayed exactly.
+ */
+static void idle(void) {
+        static double t0 = 0, acc = 0;
+        double t = gl4dGetElapsedTime();
+        unsigned char keys;
+        streamLevel();
+        acc += (t - t0) / 1000.0;
+        t0 = t;
+        /* do not try to catch up after a long freeze */
+        if (acc > 0.25)
+                acc = 0.25;
+        while (acc >= TICK) {
+                keys = getKeys();
+                /* all balls collected : next level as soon as it is uploaded,
+                 * the swap is recorded with the keys of its tick */
+                if (!_balls.count && _nextState == NEXT_READY) {
+                        swapLevel();
+                        keys |= REPLAY_NEXT_LEVEL;
+                }
+                recordTick(keys);
+                simulate(TICK);
+                acc -= TICK;
+        }
+}
+
+/*!\brief advances the simulation by one tick.
  *
  * uses the virtual keyboard states to move the camera according to
  * direction, orientation and time (dt = delta-time)
  */
-static void idle(void) {
-        Point old;
+static void simulate(double dt) {
         Cercle player;
 
-        double dt, dtheta = M_PI, step = 30.0;
-        static double t0 = 0, t;
-        dt = ((t = gl4dGetElapsedTime()) - t0) / 1000.0;
-        t0 = t;
+        double dtheta = M_PI, step = 30.0;
         if (_keys[KLEFT])
                 _cam.theta += dt * dtheta;
         if (_keys[KRIGHT])
                 _cam.theta -= dt * dtheta;
 
-        player.x = old.x = _cam.x;
-        player.y = old.y = _cam.z;
+        player.x = _cam.x;
+        player.y = _cam.z;
         player.rayon = 1.5f;
 
         GLfloat s = sin(_cam.theta);
@@ -321,32 +594,41 @@ static void idle(void) {
                 player.y += dt * step * c;
         }
 
-        int res_col = hit_mur(player, old);
+        /* one field lookup pushes the player out of the walls and keeps
+         * the tangential part of the move (sliding) */
+        sdfCollide(&_wallsSdf, &player.x, &player.y, player.rayon);
         hit_ball(player);
-        if (res_col == 0) {
-                _cam.x = player.x;
-                _cam.z = player.y;
-        } else if (res_col == 2) {
-                int res_s = (s != 0) ? (s > 0) ? 1 : -1 : 0;
-                if (_keys[KUP]) {
-                        _cam.x += -dt * step * res_s;
-                }
-                if (_keys[KDOWN]) {
-                        _cam.x += dt * step * res_s;
-                }
-        } else if (res_col == 3) {
-                int res_c = (c != 0) ? (c > 0) ? 1 : -1 : 0;
-                if (_keys[KUP]) {
-                        _cam.z += -dt * step * res_c;
-                }
-                if (_keys[KDOWN]) {
-                        _cam.z += dt * step * res_c;
-                }
-        }
+        _cam.x = player.x;
+        _cam.z = player.y;
 
         updatePosition();
 }
 
+/*!\brief applies the mipmapping and anisotropic toggles to the plane
+ * texture (also called when a new level brings its own texture). */
+static void planeTexFilters(void) {
+        glBindTexture(GL_TEXTURE_2D, _planeTexId);
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER,
+                        _mipmap ? GL_LINEAR_MIPMAP_LINEAR : GL_NEAREST);
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                        _mipmap ? GL_LINEAR_MIPMAP_LINEAR : GL_NEAREST);
+        if (_mipmap) {
+                glGenerateMipmap(GL_TEXTURE_2D);
+                /* the mipmap chain adds about a third */
+                memGLAlloc(MEM_TEXTURE, _planeTexId,
+                           _lab_side * _lab_side * sizeof *_labyrinth * 4 / 3);
+        }
+/* l'Anisotropic sous GL ne fonctionne que si la version de la
+   bibliothèque le supporte ; supprimer le bloc ci-après si
+   problème à la compilation. */
+#ifdef GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT
+        GLfloat max;
+        glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &max);
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, _anisotropic ? max : 1.0f);
+#endif
+        glBindTexture(GL_TEXTURE_2D, 0);
+}
+
 /*!\brief function called by GL4Dummies' loop at key-down (key
  * pressed) event.
  *
@@ -384,33 +666,54 @@ static void keydown(int keycode) {
                 break;
         /* when 'm' pressed, toggle between mipmapping or nearest for the plane
          * texture */
-        case 'm': {
+        case 'm':
                 _mipmap = !_mipmap;
-                glBindTexture(GL_TEXTURE_2D, _planeTexId);
-                glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER,
-                                _mipmap ? GL_LINEAR_MIPMAP_LINEAR : GL_NEAREST);
-                glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
-                                _mipmap ? GL_LINEAR_MIPMAP_LINEAR : GL_NEAREST);
-                glGenerateMipmap(GL_TEXTURE_2D);
-                glBindTexture(GL_TEXTURE_2D, 0);
+                planeTexFilters();
                 break;
-        }
         /* when 'a' pressed, toggle on/off the anisotropic mode */
-        case 'a': {
+        case 'a':
                 _anisotropic = !_anisotropic;
-/* l'Anisotropic sous GL ne fonctionne que si la version de la
-   bibliothèque le supporte ; supprimer le bloc ci-après si
-   problème à la compilation. */
-#ifdef GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT
-                GLfloat max;
-                glBindTexture(GL_TEXTURE_2D, _planeTexId);
-                glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &max);
-                glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT,
-                                _anisotropic ? max : 1.0f);
-                glBindTexture(GL_TEXTURE_2D, 0);
-#endif
+                planeTexFilters();
+                break;
+        /* when 'i' pressed, print the render queue counters of the last frame */
+        case 'i': {
+                rqstats_t st;
+                drstats_t ds;
+                rqStats(&st);
+                printf("render queue (%s ring): %u items in %u batches, %u draws\n",
+                       st.persistent ? "persistent" : "mapped", st.items, st.batches, st.draws);
+                printf("  state changes %u (naive %u, saved %d)\n", st.stateChanges,
+                       st.naiveStateChanges, (int)st.naiveStateChanges - (int)st.stateChanges);
+                printf("  driver calls %u\n", st.calls);
+                if (_gpuOn) {
+                        gpustats_t gs;
+                        gpuStats(&gs);
+                        printf("gpu culling: %u/%u walls, %u/%u balls drawn\n",
+                               gs.visibleWalls, gs.walls, gs.visibleBalls, gs.balls);
+                }
+                drStats(&ds);
+                printf("resolution %.0f%% (%u changes), frame %.2f ms (last %.2f ms)",
+                       100.0 * ds.scale, ds.changes, ds.frame, ds.last);
+                if (ds.budget > 0.0)
+                        printf(", budget %.2f ms", ds.budget);
+                printf("\n");
                 break;
         }
+        /* when 'd' pressed, toggle the dynamic resolution */
+        case 'd':
+                _dynres = !_dynres;
+                drSetBudget(_dynres ? _budget : 0.0);
+                printf("dynamic resolution %s\n", _dynres ? "on" : "off");
+                break;
+        /* when 'r' pressed, print the memory used by category */
+        case 'r':
+                memReport(stdout);
+                break;
+        /* when 'g' pressed, toggle the GPU-driven culling and drawing */
+        case 'g':
+                _gpuOn = _gpuCull && !_gpuOn;
+                printf("gpu culling %s\n", _gpuOn ? "on" : _gpuCull ? "off" : "unavailable");
+                break;
         default:
                 break;
         }
@@ -447,12 +750,23 @@ static void pmotion(int x, int y) {
         _ym = y;
 }
 
-/*!\brief function called by GL4Dummies' loop at draw.*/
+/*!\brief function called by GL4Dummies' loop at draw.
+ *
+ * records every object in the render queue, which sorts and submits
+ * them at the end of the frame. With GPU culling, the scene goes to
+ * an offscreen framebuffer and walls and balls are drawn by gpuDraw.
+ * With dynamic resolution, the scene is rendered smaller and upscaled
+ * before the overlays are drawn.*/
 static void draw(void) {
+        static GLboolean first = GL_TRUE;
+        GLint w, h;
+        GLboolean scaled = drBegin(!_gpuOn);
+        if (_gpuOn) {
+                drSceneSize(&w, &h);
+                gpuBegin(w, h);
+        }
         /* clears the OpenGL color buffer and depth buffer */
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        /* sets the current program shader to _pId */
-        glUseProgram(_pId);
         gl4duBindMatrix("viewMatrix");
         /* loads the identity matrix in the current GL4Dummies matrix ("viewMatrix")
          */
@@ -463,262 +777,289 @@ static void draw(void) {
         gl4duLookAtf(_cam.x, 3.0, _cam.z, _cam.x - sin(_cam.theta),
                      3.0 - (_ym - (_wH >> 1)) / (GLfloat)_wH,
                      _cam.z - cos(_cam.theta), 0.0, 1.0, 0.0);
-        gl4duBindMatrix("modelMatrix");
+        /* the scene items are seen through this camera */
+        rqCamera();
         /* loads the identity matrix in the current GL4Dummies matrix ("modelMatrix")
          */
         gl4duLoadIdentityf();
-        /* sets the current texture stage to 0 */
-        glActiveTexture(GL_TEXTURE0);
-        /* tells the pId program that "tex" is set to stage 0 */
-        glUniform1i(glGetUniformLocation(_pId, "tex"), 0);
 
         /* pushs (saves) the current matrix (modelMatrix), scales, rotates,
-         * sends matrices to pId and then pops (restore) the matrix */
+         * records the plane and then pops (restore) the matrix */
         gl4duPushMatrix();
         {
                 gl4duRotatef(-90, 1, 0, 0);
                 gl4duScalef(_planeScale, _planeScale, 1);
-                gl4duSendMatrices();
+                /* the plane uses the checkboard texture, culls the back faces */
+                rqPush(RQ_SCENE, RQ_CULL | RQ_DEPTH, _planeTexId, MESH_QUAD, 1.0, 0);
         }
         gl4duPopMatrix();
-        /* culls the back faces */
-        glCullFace(GL_BACK);
-        /* uses the checkboard texture */
-        glBindTexture(GL_TEXTURE_2D, _planeTexId);
-        /* sets in pId the uniform variable texRepeat to the plane scale */
-        glUniform1f(glGetUniformLocation(_pId, "texRepeat"), 1.0);
-        /* draws the plane */
-        gl4dgDraw(_plane);
 
-        my_draw();
+        if (_gpuOn)
+                drawGPU();
+        else {
+                my_draw();
+                /* the overlays are not rendered at the scene resolution */
+                if (scaled)
+                        rqFlush();
+        }
+        drEnd();
 
         /* the compass should be drawn in an orthographic projection, thus
          * we should bind the projection matrix; save it; load identity;
-         * bind the model-view matrix; modify it to place the compass at the
-         * top left of the screen and rotate the compass according to the
-         * camera orientation (theta); send matrices; restore the model-view
-         * matrix; bind the projection matrix and restore it; and then
-         * re-bind the model-view matrix for after.*/
+         * bind the view matrix; save it and load identity; take them as
+         * the queue camera; place the compass at the top left of the screen
+         * and rotate it according to the camera orientation (theta); and
+         * then restore the matrices.*/
         gl4duBindMatrix("projectionMatrix");
         gl4duPushMatrix();
+        gl4duLoadIdentityf();
+        gl4duBindMatrix("viewMatrix");
+        gl4duPushMatrix();
+        gl4duLoadIdentityf();
+        rqCamera();
+        gl4duPushMatrix();
         {
                 gl4duLoadIdentityf();
-                gl4duBindMatrix("modelMatrix");
-                gl4duPushMatrix();
-                {
-                        gl4duLoadIdentityf();
-                        gl4duTranslatef(-0.75, 0.7, 0.0);
-                        gl4duRotatef(-_cam.theta * 180.0 / M_PI, 0, 0, 1);
-                        gl4duScalef(0.03 / 5.0, 1.0 / 5.0, 1.0 / 5.0);
-                        gl4duBindMatrix("viewMatrix");
-                        gl4duPushMatrix();
-                        {
-                                gl4duLoadIdentityf();
-                                gl4duSendMatrices();
-                        }
-                        gl4duPopMatrix();
-                        gl4duBindMatrix("modelMatrix");
-                }
-                gl4duPopMatrix();
-                gl4duBindMatrix("projectionMatrix");
+                gl4duTranslatef(-0.75, 0.7, 0.0);
+                gl4duRotatef(-_cam.theta * 180.0 / M_PI, 0, 0, 1);
+                gl4duScalef(0.03 / 5.0, 1.0 / 5.0, 1.0 / 5.0);
+                /* no cull facing nor depth testing, texture repeat only once */
+                rqPush(RQ_OVERLAY, 0, _compassTexId, MESH_QUAD, 1.0, 0);
         }
         gl4duPopMatrix();
-        gl4duBindMatrix("modelMatrix");
-        /* disables cull facing and depth testing */
-        glDisable(GL_CULL_FACE);
-        glDisable(GL_DEPTH_TEST);
-        /* uses the compass texture */
-        glBindTexture(GL_TEXTURE_2D, _compassTexId);
-        /* texture repeat only once */
-        glUniform1f(glGetUniformLocation(_pId, "texRepeat"), 1);
-        /* draws the compass */
-        gl4dgDraw(_plane);
 
+        /* the map uses the same view but an orthographic projection */
         gl4duBindMatrix("projectionMatrix");
+        gl4duOrthof(-1.0, 1.0, -_wH / (GLfloat)_wW, _wH / (GLfloat)_wW, 0.0, 2.0);
+        rqCamera();
         gl4duPushMatrix();
         {
                 gl4duLoadIdentityf();
-                gl4duOrthof(-1.0, 1.0, -_wH / (GLfloat)_wW, _wH / (GLfloat)_wW, 0.0, 2.0);
-                gl4duBindMatrix("modelMatrix");
-                gl4duPushMatrix();
-                {
-                        gl4duLoadIdentityf();
-                        gl4duTranslatef(0.75, -0.4, 0.0);
-                        gl4duRotatef(-_cam.theta * 180.0 / M_PI, 0, 0, 1);
-                        gl4duScalef(1.0 / 5.0, 1.0 / 5.0, 1.0);
-                        gl4duBindMatrix("viewMatrix");
-                        gl4duPushMatrix();
-                        {
-                                gl4duLoadIdentityf();
-                                gl4duSendMatrices();
-                        }
-                        gl4duPopMatrix();
-                        gl4duBindMatrix("modelMatrix");
-                }
-                gl4duPopMatrix();
-                gl4duBindMatrix("projectionMatrix");
+                gl4duTranslatef(0.75, -0.4, 0.0);
+                gl4duRotatef(-_cam.theta * 180.0 / M_PI, 0, 0, 1);
+                gl4duScalef(1.0 / 5.0, 1.0 / 5.0, 1.0);
+                /* draws the map with borders using the labyrinth texture */
+                rqPush(RQ_OVERLAY, 0, _planeTexId, MESH_QUAD, 1.0, 1);
         }
         gl4duPopMatrix();
+        gl4duBindMatrix("viewMatrix");
+        gl4duPopMatrix();
+        gl4duBindMatrix("projectionMatrix");
+        gl4duPopMatrix();
         gl4duBindMatrix("modelMatrix");
-        /* disables cull facing and depth testing */
-        glDisable(GL_CULL_FACE);
-        glDisable(GL_DEPTH_TEST);
-        /* uses the labyrinth texture */
-        glBindTexture(GL_TEXTURE_2D, _planeTexId);
-        /* draws borders */
-        glUniform1i(glGetUniformLocation(_pId, "border"), 1);
-        /* draws the map */
-        gl4dgDraw(_plane);
-        /* do not draw borders */
-        glUniform1i(glGetUniformLocation(_pId, "border"), 0);
-
-        /* enables cull facing and depth testing */
-        glEnable(GL_DEPTH_TEST);
-        glEnable(GL_CULL_FACE);
+
+        /* sorts and submits everything */
+        rqFlush();
+        /* the render queue and its ring take their size at the first frame */
+        if (first) {
+                memCheckpoint("level 1");
+                first = GL_FALSE;
+        }
+}
+
+/*!\brief FNV-1a hash of the simulation state (camera, balls and
+ * labyrinth marks), used to compare replays. */
+static unsigned long long stateHash(void) {
+        unsigned long long h = 14695981039346656037ULL;
+        const unsigned char *p[4] = {
+                (const unsigned char *)&_cam, (const unsigned char *)_balls.x,
+                (const unsigned char *)_balls.z, (const unsigned char *)_labyrinth};
+        size_t n[4] = {sizeof _cam, _balls.count * sizeof *_balls.x,
+                       _balls.count * sizeof *_balls.z,
+                       _lab_side * _lab_side * sizeof *_labyrinth};
+        size_t i, k;
+        for (k = 0; k < 4; ++k)
+                for (i = 0; i < n[k]; ++i)
+                        h = (h ^ p[k][i]) * 1099511628211ULL;
+        return h;
+}
+
+/*!\brief re-executes a recorded session without window nor OpenGL,
+ * as fast as possible, then reports the simulation throughput and
+ * the final state hash.
+ * \return 0 on success, 1 if the record can't be opened or read to
+ * its end or a level can't be generated. */
+static int replay(const char *filename) {
+        unsigned char keys;
+        unsigned long ticks = 0;
+        double secs;
+        clock_t c;
+        int r;
+        if (replayOpen(filename, &_seed, &_lab_side) < 0)
+                return 1;
+        initLevel();
+        memCheckpoint("level 1");
+        c = clock();
+        while ((r = replayTick(&keys)) > 0) {
+                if (keys & REPLAY_NEXT_LEVEL) {
+                        if (levelBuild(&_next, levelSeed(_seed, _levelNum + 1), _lab_side,
+                                       _planeScale, SDF_RES, 0,
+                                       sysconf(_SC_NPROCESSORS_ONLN)) < 0) {
+                                fprintf(stderr, "can't generate level %u\n", _levelNum + 2);
+                                r = -1;
+                                break;
+                        }
+                        swapLevel();
+                }
+                setKeys(keys);
+                simulate(TICK);
+                ++ticks;
+        }
+        secs = (clock() - c) / (double)CLOCKS_PER_SEC;
+        replayClose();
+        printf("replay: %lu ticks (%.1f s of play) in %.3f s, %.0f ticks/s\n", ticks,
+               ticks * TICK, secs, secs > 0 ? ticks / secs : 0.0);
+        /* a broken session has no state to compare */
+        if (r < 0)
+                fprintf(stderr, "replay: %s failed after %lu ticks\n", filename, ticks);
+        else
+                printf("replay: state hash %016llx\n", stateHash());
+        memReport(stdout);
+        memFree(_labyrinth);
+        pickupsFree(&_balls);
+        sdfFree(&_wallsSdf);
+        memLeaks(stderr);
+        return r < 0;
 }
 
 /*!\brief function called at exit. Frees used textures and clean-up
  * GL4Dummies.*/
 static void quit(void) {
+        GLuint *textures[] = {&_planeTexId, &_nextTexId, &_compassTexId, &_wallTexId,
+                              &_ballTexId};
+        int i;
+        recordClose();
+        if (_nextState == NEXT_GEN)
+                levelWait();
+        levelFree(&_next);
         if (_labyrinth)
-                free(_labyrinth);
-        if (_planeTexId)
-                glDeleteTextures(1, &_planeTexId);
-        if (_compassTexId)
-                glDeleteTextures(1, &_compassTexId);
-        if (_wallTexId)
-                glDeleteTextures(1, &_wallTexId);
-        if (_ballTexId)
-                glDeleteTextures(1, &_ballTexId);
+                memFree(_labyrinth);
+        pickupsFree(&_balls);
+        sdfFree(&_wallsSdf);
+        rqClean();
+        gpuClean();
+        drClean();
+        pvsFree(&_pvs);
+        memFree(_visible);
+        for (i = 0; i < 5; ++i)
+                if (*textures[i]) {
+                        memGLFree(MEM_TEXTURE, *textures[i]);
+                        glDeleteTextures(1, textures[i]);
+                }
         gl4duClean(GL4DU_ALL);
+        /* everything is released, what is left leaked */
+        memReport(stdout);
+        memLeaks(stderr);
+}
+
+/*!\brief selects the visible set of the camera cell : the previous
+ * set is cleared and the new one marked in _visible. */
+static void updateVisible(void) {
+        const GLuint *runs;
+        GLuint n, k, c;
+        int xi, zi, cell;
+        if (!_visible || !_pvs.offsets)
+                return;
+        xi = (int)((_cam.x + _planeScale) / (2.0f * _planeScale) * _lab_side);
+        zi = (int)((-_cam.z + _planeScale) / (2.0f * _planeScale) * _lab_side);
+        cell = zi * _lab_side + xi;
+        if (xi < 0 || xi >= _lab_side || zi < 0 || zi >= _lab_side ||
+            _labyrinth[cell] == -1)
+                cell = -1;
+        if (cell == _pvsCell)
+                return;
+        if (_pvsCell >= 0)
+                for (runs = pvsCell(&_pvs, _pvsCell, &n), k = 0; k < n; ++k)
+                        memset(_visible + runs[2 * k], 0, runs[2 * k + 1]);
+        if ((_pvsCell = cell) >= 0)
+                for (runs = pvsCell(&_pvs, _pvsCell, &n), k = 0; k < n; ++k)
+                        for (c = runs[2 * k]; c < runs[2 * k] + runs[2 * k + 1]; ++c)
+                                _visible[c] = 1;
+}
+
+static void drawWall(int i, int j) {
+        GLfloat unit = (_planeScale * 2.0f) / _lab_side;
+        gl4duPushMatrix();
+        {
+                gl4duTranslatef((i * unit) - _planeScale + unit / 2, 0,
+                                -((j * unit) - _planeScale + unit / 2));
+                gl4duScalef((_planeScale / _lab_side), 4, (_planeScale / _lab_side));
+                rqPush(RQ_SCENE, RQ_CULL | RQ_DEPTH, _wallTexId, MESH_CUBE, 1.0, 0);
+        }
+        gl4duPopMatrix();
 }
 
 void drawWalls() {
         int i, j;
-        GLfloat unit = (_planeScale * 2.0f) / _lab_side;
-        for (j = 0; j < _lab_side; j++) {
-                for (i = 0; i < _lab_side; i++) {
-                        if (_labyrinth[j * _lab_side + i] == -1) {
-                                gl4duPushMatrix();
-                                {
-                                        gl4duTranslatef((i * unit) - _planeScale + unit / 2, 0,
-                                                        -((j * unit) - _planeScale + unit / 2));
-                                        gl4duScalef((_planeScale / _lab_side), 4, (_planeScale / _lab_side));
-                                        gl4duSendMatrices();
-                                }
-                                gl4duPopMatrix();
-                                gl4dgDraw(_cube);
-                        }
-                }
+        const GLuint *runs;
+        GLuint n, k, c;
+        /* only the walls of the camera cell visible set */
+        if (_pvsCell >= 0) {
+                for (runs = pvsCell(&_pvs, _pvsCell, &n), k = 0; k < n; ++k)
+                        for (c = runs[2 * k]; c < runs[2 * k] + runs[2 * k + 1]; ++c)
+                                if (_labyrinth[c] == -1)
+                                        drawWall(c % _lab_side, c / _lab_side);
+                return;
         }
+        for (j = 0; j < _lab_side; j++)
+                for (i = 0; i < _lab_side; i++)
+                        if (_labyrinth[j * _lab_side + i] == -1)
+                                drawWall(i, j);
 }
 
 void drawBalls() {
-        int i;
-        GLfloat xi, zi;
-        for (i = 0; i < nb_ball; i += 2) {
-                xi = balls[i];
-                zi = balls[i + 1];
+        int i, xc, zc;
+        GLfloat xi, zi, unit = (_planeScale * 2.0f) / _lab_side;
+        for (i = 0; i < _balls.count; i++) {
+                xi = _balls.x[i];
+                zi = _balls.z[i];
+                if (_pvsCell >= 0) {
+                        xc = (int)((xi + _planeScale) / unit);
+                        zc = (int)((-zi + _planeScale) / unit);
+                        if (!_visible[zc * _lab_side + xc])
+                                continue;
+                }
                 gl4duPushMatrix();
                 {
                         gl4duTranslatef(xi, 2, zi);
                         gl4duScalef((_planeScale / _lab_side) / 4, 1,
                                     (_planeScale / _lab_side) / 4);
-                        gl4duSendMatrices();
+                        rqPush(RQ_SCENE, RQ_CULL | RQ_DEPTH, _ballTexId, MESH_SPHERE, 1.0, 0);
                 }
                 gl4duPopMatrix();
-                gl4dgDraw(_sphere);
         }
 }
 
+/*!\brief submits the floor, then culls and draws the walls and balls
+ * on the GPU ; the ball instances are re-uploaded when some were
+ * collected. */
+static void drawGPU(void) {
+        GLfloat pv[16];
+        rqFlush();
+        if (_balls.count != _gpuBalls) {
+                gpuSetBalls(_balls.x, _balls.z, _balls.count, (_planeScale / _lab_side) / 4);
+                _gpuBalls = _balls.count;
+        }
+        rqGetCamera(pv);
+        gpuDraw(pv, _wallTexId, _ballTexId);
+        gpuEnd();
+}
+
 void my_draw() {
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, _wallTexId);
+        updateVisible();
         drawWalls();
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, _ballTexId);
         drawBalls();
 }
 
-void remove_ball(int idx) {
-        balls[idx] = balls[nb_ball - 2];
-        balls[idx + 1] = balls[nb_ball - 1];
-        nb_ball -= 2;
-}
-
 void hit_ball(Cercle player) {
         int i;
-        GLfloat xi, zi;
-
-        for (i = 0; i < nb_ball; i += 2) {
-                xi = balls[i];
-                zi = balls[i + 1];
-                if (CollisionPointCercle(xi, zi, player) == 1) {
-                        // printf("Vous avez eu la balle n%d\n", (i + 2)/2);
-                        remove_ball(i);
-                        show_info_balle();
-                }
-        }
-}
-
-int hit(Cercle player, Cercle p) {
-        GLfloat xf, zf;
-        int xi, zi, i, j;
-
-        xf = player.x + _planeScale;
-        zf = -player.y + _planeScale;
-
-        xf = xf / (2.0f * _planeScale);
-        zf = zf / (2.0f * _planeScale);
-
-        xf = xf * _lab_side;
-        zf = zf * _lab_side;
-
-        xi = (int)xf;
-        zi = (int)zf;
-
-        GLfloat unit = (_planeScale * 2.0f) / _lab_side;
-
-        for (j = zi - 1; j <= zi + 1; j++) {
-                for (i = xi - 1; i <= xi + 1; i++) {
-                        if (_labyrinth[j * _lab_side + i] == -1) {
-                                AABB wall;
-                                wall.x = ((i * unit) - _planeScale);
-                                wall.y = -((j * unit) - _planeScale) - unit;
-                                wall.w = unit;
-                                wall.h = unit;
-
-                                if (CollisionCercleAABB(p, wall) == 1) {
-                                        return 1;
-                                }
-                        }
-                }
-        }
-        return 0;
-}
-
-int hit_mur(Cercle player, Point old) {
 
-        if (hit(player, player) == 1) {
-                Cercle p;
-                p.x = player.x;
-                p.y = old.y;
-                p.rayon = player.rayon;
-
-                int col1 = hit(player, p);
-
-                p.x = old.x;
-                p.y = player.y;
-                p.rayon = player.rayon;
-
-                int col2 = hit(player, p);
-                if (col1 == 1 && col2 == 1) {
-                        return 1;
-                } else if (col1 == 1 && col2 == 0) {
-                        return 3;
-                } else if (col1 == 0 && col2 == 1) {
-                        return 2;
+        /* backward, removal moves the last ball into the hole */
+        for (i = (int)_balls.count - 1; i >= 0; i--) {
+                if (CollisionPointCercle(_balls.x[i], _balls.z[i], player) == 1) {
+                        // printf("Vous avez eu la balle n%d\n", i + 1);
+                        pickupsRemove(&_balls, pickupsHandle(&_balls, i));
+                        show_info_balle();
                 }
         }
-        return 0;
 }